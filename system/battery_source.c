@@ -0,0 +1,137 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <gio/gio.h>
+
+#include "battery_source.h"
+
+enum
+{
+    SAMPLE,
+    ONLINE_CHANGED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+G_DEFINE_INTERFACE (BatterySource, battery_source, G_TYPE_OBJECT)
+
+static void
+battery_source_default_init (BatterySourceInterface *iface)
+{
+    signals[SAMPLE] = g_signal_new (
+        "sample",
+        G_TYPE_FROM_INTERFACE (iface),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL, NULL, NULL,
+        G_TYPE_NONE,
+        1,
+        G_TYPE_VARIANT
+    );
+
+    signals[ONLINE_CHANGED] = g_signal_new (
+        "online-changed",
+        G_TYPE_FROM_INTERFACE (iface),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL, NULL, NULL,
+        G_TYPE_NONE,
+        1,
+        G_TYPE_BOOLEAN
+    );
+}
+
+/**
+ * battery_source_start:
+ *
+ * Start sending samples, current values are sent first.
+ *
+ * @self: a #BatterySource
+ */
+void
+battery_source_start (BatterySource *self)
+{
+    BATTERY_SOURCE_GET_IFACE (self)->start (self);
+}
+
+/**
+ * battery_source_set_charging:
+ *
+ * Tell source if charge is allowed, used by simulated sources.
+ *
+ * @self: a #BatterySource
+ * @charging: TRUE if charging
+ */
+void
+battery_source_set_charging (BatterySource *self,
+                             gboolean       charging)
+{
+    BatterySourceInterface *iface = BATTERY_SOURCE_GET_IFACE (self);
+
+    if (iface->set_charging != NULL)
+        iface->set_charging (self, charging);
+}
+
+/**
+ * battery_source_emit_sample:
+ *
+ * Emit a battery sample.
+ *
+ * @self: a #BatterySource
+ * @sample: (transfer floating): a{sv} sample
+ */
+void
+battery_source_emit_sample (BatterySource *self,
+                            GVariant      *sample)
+{
+    g_autoptr (GVariant) value = g_variant_ref_sink (sample);
+
+    g_signal_emit (self, signals[SAMPLE], 0, value);
+}
+
+/**
+ * battery_source_emit_online:
+ *
+ * Emit charger online state.
+ *
+ * @self: a #BatterySource
+ * @online: TRUE if a charger is online
+ */
+void
+battery_source_emit_online (BatterySource *self,
+                            gboolean       online)
+{
+    g_signal_emit (self, signals[ONLINE_CHANGED], 0, online);
+}
+
+/**
+ * battery_source_state_to_online:
+ *
+ * Guess charger online state from battery state.
+ *
+ * @state: a battery state
+ * @online: (out): TRUE if a charger is online
+ *
+ * Returns: FALSE if state does not tell
+ */
+gboolean
+battery_source_state_to_online (guint32   state,
+                                gboolean *online)
+{
+    switch (state) {
+        case BATTERY_STATE_CHARGING:
+        case BATTERY_STATE_FULLY_CHARGED:
+        case BATTERY_STATE_PENDING_CHARGE:
+            *online = TRUE;
+            return TRUE;
+        case BATTERY_STATE_DISCHARGING:
+        case BATTERY_STATE_PENDING_DISCHARGE:
+        case BATTERY_STATE_EMPTY:
+            *online = FALSE;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef BATTERY_SOURCE_H
+#define BATTERY_SOURCE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+// Battery states, as defined by UPower
+#define BATTERY_STATE_UNKNOWN            0
+#define BATTERY_STATE_CHARGING           1
+#define BATTERY_STATE_DISCHARGING        2
+#define BATTERY_STATE_EMPTY              3
+#define BATTERY_STATE_FULLY_CHARGED      4
+#define BATTERY_STATE_PENDING_CHARGE     5
+#define BATTERY_STATE_PENDING_DISCHARGE  6
+
+#define TYPE_BATTERY_SOURCE \
+    (battery_source_get_type ())
+#define BATTERY_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_BATTERY_SOURCE, BatterySource))
+#define IS_BATTERY_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_BATTERY_SOURCE))
+#define BATTERY_SOURCE_GET_IFACE(obj) \
+    (G_TYPE_INSTANCE_GET_INTERFACE \
+    ((obj), TYPE_BATTERY_SOURCE, BatterySourceInterface))
+
+G_BEGIN_DECLS
+
+typedef struct _BatterySource BatterySource;
+typedef struct _BatterySourceInterface BatterySourceInterface;
+
+/*
+ * Samples are a{sv} dictionaries using UPower device property names:
+ * Percentage (d), TimeToFull (x), Energy (d), EnergyFull (d),
+ * EnergyRate (d). Only changed values need to be sent.
+ */
+struct _BatterySourceInterface {
+    GTypeInterface parent_iface;
+
+    void (*start)        (BatterySource *self);
+    void (*set_charging) (BatterySource *self,
+                          gboolean       charging);
+};
+
+GType           battery_source_get_type           (void) G_GNUC_CONST;
+
+void            battery_source_start              (BatterySource *self);
+void            battery_source_set_charging       (BatterySource *self,
+                                                   gboolean       charging);
+void            battery_source_emit_sample        (BatterySource *self,
+                                                   GVariant      *sample);
+void            battery_source_emit_online        (BatterySource *self,
+                                                   gboolean       online);
+gboolean        battery_source_state_to_online    (guint32        state,
+                                                   gboolean      *online);
+
+G_END_DECLS
+
+#endif
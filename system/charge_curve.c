@@ -0,0 +1,391 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "charge_curve.h"
+
+#define CHARGE_CURVE_MAGIC     0x4d494243
+#define CHARGE_CURVE_VERSION   1
+#define CHARGE_CURVE_TYPE_SIZE 32
+#define CHARGE_CURVE_STEPS     100
+#define CHARGE_CURVE_MAX_STEP  G_MAXUINT16
+
+enum {
+    PROP_0,
+    PROP_FILENAME
+};
+
+typedef struct {
+    guint32 magic;
+    guint32 version;
+    guint32 count;
+} ChargeCurveHeader;
+
+/*
+ * One table per charger type: seconds needed to charge from a percentage
+ * to the next one. Prefix sums are not stored on disk.
+ */
+typedef struct {
+    gchar type[CHARGE_CURVE_TYPE_SIZE];
+    guint16 steps[CHARGE_CURVE_STEPS];
+} ChargeCurveTable;
+
+typedef struct {
+    ChargeCurveTable table;
+    guint32 time[CHARGE_CURVE_STEPS + 1];
+    guint8 unknown[CHARGE_CURVE_STEPS + 1];
+} ChargeCurveEntry;
+
+struct _ChargeCurvePrivate {
+    gchar *filename;
+    GHashTable *entries;
+    ChargeCurveEntry *entry;
+
+    gint64 last_timestamp;
+    gint last_step;
+    gboolean last_aligned;
+    gboolean changed;
+};
+
+G_DEFINE_TYPE_WITH_CODE (
+    ChargeCurve,
+    charge_curve,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (ChargeCurve)
+)
+
+static void
+update_prefix_sums (ChargeCurveEntry *entry) {
+    gint i;
+
+    entry->time[0] = 0;
+    entry->unknown[0] = 0;
+    for (i = 0; i < CHARGE_CURVE_STEPS; i++) {
+        entry->time[i + 1] = entry->time[i] + entry->table.steps[i];
+        entry->unknown[i + 1] = entry->unknown[i] +
+            (entry->table.steps[i] == 0 ? 1 : 0);
+    }
+}
+
+static ChargeCurveEntry *
+add_entry (ChargeCurve      *self,
+           ChargeCurveTable *table) {
+    ChargeCurveEntry *entry = g_new0 (ChargeCurveEntry, 1);
+
+    memcpy (&entry->table, table, sizeof (ChargeCurveTable));
+    entry->table.type[CHARGE_CURVE_TYPE_SIZE - 1] = '\0';
+    update_prefix_sums (entry);
+
+    g_hash_table_replace (self->priv->entries, entry->table.type, entry);
+
+    return entry;
+}
+
+static void
+charge_curve_load (ChargeCurve *self) {
+    g_autoptr (GError) error = NULL;
+    g_autofree gchar *content = NULL;
+    ChargeCurveHeader *header;
+    ChargeCurveTable *tables;
+    gsize size;
+    guint i;
+
+    if (self->priv->filename == NULL)
+        return;
+
+    if (!g_file_get_contents (self->priv->filename, &content, &size, &error)) {
+        g_message ("No charge curves: %s", error->message);
+        return;
+    }
+
+    header = (ChargeCurveHeader *) content;
+    if (size < sizeof (ChargeCurveHeader) ||
+            header->magic != CHARGE_CURVE_MAGIC ||
+            header->version != CHARGE_CURVE_VERSION ||
+            size != sizeof (ChargeCurveHeader) +
+                header->count * sizeof (ChargeCurveTable)) {
+        g_warning ("Invalid charge curves file: %s", self->priv->filename);
+        return;
+    }
+
+    tables = (ChargeCurveTable *) (content + sizeof (ChargeCurveHeader));
+    for (i = 0; i < header->count; i++)
+        add_entry (self, &tables[i]);
+
+    g_message ("Loaded %u charge curves", header->count);
+}
+
+static void
+charge_curve_set_property (GObject *object,
+                           guint property_id,
+                           const GValue *value,
+                           GParamSpec *pspec)
+{
+    ChargeCurve *self = CHARGE_CURVE (object);
+
+    switch (property_id) {
+        case PROP_FILENAME:
+            self->priv->filename = g_value_dup_string (value);
+            charge_curve_load (self);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+charge_curve_dispose (GObject *charge_curve)
+{
+    ChargeCurve *self = CHARGE_CURVE (charge_curve);
+
+    if (self->priv->entries != NULL)
+        charge_curve_save (self);
+
+    g_clear_pointer (&self->priv->entries, g_hash_table_unref);
+    g_clear_pointer (&self->priv->filename, g_free);
+
+    G_OBJECT_CLASS (charge_curve_parent_class)->dispose (charge_curve);
+}
+
+static void
+charge_curve_finalize (GObject *charge_curve)
+{
+    G_OBJECT_CLASS (charge_curve_parent_class)->finalize (charge_curve);
+}
+
+static void
+charge_curve_class_init (ChargeCurveClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = charge_curve_dispose;
+    object_class->finalize = charge_curve_finalize;
+    object_class->set_property = charge_curve_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_FILENAME,
+        g_param_spec_string (
+            "filename",
+            "Charge curves file",
+            "Charge curves file",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+}
+
+static void
+charge_curve_init (ChargeCurve *self)
+{
+    self->priv = charge_curve_get_instance_private (self);
+
+    self->priv->filename = NULL;
+    self->priv->entries = g_hash_table_new_full (
+        g_str_hash, g_str_equal, NULL, g_free
+    );
+    self->priv->entry = NULL;
+    self->priv->changed = FALSE;
+
+    charge_curve_reset (self);
+}
+
+/**
+ * charge_curve_new:
+ *
+ * Creates a new #ChargeCurve
+ *
+ * @filename: (nullable): file used to persist curves
+ *
+ * Returns: (transfer full): a new #ChargeCurve
+ *
+ **/
+GObject *
+charge_curve_new (const gchar *filename)
+{
+    GObject *charge_curve;
+
+    charge_curve = g_object_new (
+        TYPE_CHARGE_CURVE, "filename", filename, NULL
+    );
+
+    return charge_curve;
+}
+
+/**
+ * charge_curve_set_type:
+ *
+ * Select curve for charger type, created if unknown.
+ *
+ * @self: a #ChargeCurve
+ * @charger_type: charger type
+ */
+void
+charge_curve_set_type (ChargeCurve *self,
+                       const gchar *charger_type) {
+    ChargeCurveTable table;
+
+    self->priv->entry = g_hash_table_lookup (
+        self->priv->entries, charger_type
+    );
+
+    if (self->priv->entry == NULL) {
+        memset (&table, 0, sizeof (ChargeCurveTable));
+        g_strlcpy (table.type, charger_type, CHARGE_CURVE_TYPE_SIZE);
+        self->priv->entry = add_entry (self, &table);
+    }
+
+    g_message ("Charger type: %s", self->priv->entry->table.type);
+    charge_curve_reset (self);
+}
+
+/**
+ * charge_curve_reset:
+ *
+ * Forget last sample, charge has been interrupted.
+ *
+ * @self: a #ChargeCurve
+ */
+void
+charge_curve_reset (ChargeCurve *self) {
+    self->priv->last_timestamp = 0;
+    self->priv->last_step = -1;
+    self->priv->last_aligned = FALSE;
+}
+
+/**
+ * charge_curve_add_sample:
+ *
+ * Learn curve from a charging sample.
+ *
+ * @self: a #ChargeCurve
+ * @timestamp: sample time in seconds
+ * @percentage: battery percentage
+ */
+void
+charge_curve_add_sample (ChargeCurve *self,
+                         gint64       timestamp,
+                         gdouble      percentage) {
+    ChargeCurveEntry *entry = self->priv->entry;
+    gint step = CLAMP ((gint) percentage, 0, CHARGE_CURVE_STEPS);
+    gint64 duration;
+    gint i;
+
+    if (entry == NULL || step == self->priv->last_step)
+        return;
+
+    // Only learn from a full step, first one after reset is partial
+    if (self->priv->last_aligned && step > self->priv->last_step) {
+        duration = (timestamp - self->priv->last_timestamp) /
+            (step - self->priv->last_step);
+        duration = CLAMP (duration, 1, CHARGE_CURVE_MAX_STEP);
+
+        for (i = self->priv->last_step; i < step; i++) {
+            guint16 *value = &entry->table.steps[i];
+
+            if (*value == 0)
+                *value = duration;
+            else
+                *value = (*value * 3 + duration) / 4;
+        }
+
+        update_prefix_sums (entry);
+        self->priv->changed = TRUE;
+    }
+
+    // A step change starts next step
+    self->priv->last_aligned = self->priv->last_step != -1;
+    self->priv->last_step = step;
+    self->priv->last_timestamp = timestamp;
+}
+
+/**
+ * charge_curve_get_time_to:
+ *
+ * Get time needed to charge between two percentages, O(1).
+ *
+ * @self: a #ChargeCurve
+ * @from: current percentage
+ * @to: wanted percentage
+ *
+ * Returns: time in seconds, -1 if curve is not learnt for this range
+ */
+gint64
+charge_curve_get_time_to (ChargeCurve *self,
+                          gdouble      from,
+                          gdouble      to) {
+    ChargeCurveEntry *entry = self->priv->entry;
+    gint start;
+    gint end;
+    gdouble partial;
+
+    if (to <= from)
+        return 0;
+
+    if (entry == NULL)
+        return -1;
+
+    start = CLAMP ((gint) from, 0, CHARGE_CURVE_STEPS - 1);
+    end = CLAMP ((gint) to, 0, CHARGE_CURVE_STEPS);
+
+    if (entry->unknown[end] - entry->unknown[start] != 0)
+        return -1;
+
+    // Current step is partially done
+    partial = (from - start) * entry->table.steps[start];
+
+    return entry->time[end] - entry->time[start] - (gint64) partial;
+}
+
+/**
+ * charge_curve_save:
+ *
+ * Save curves to disk if they changed.
+ *
+ * @self: a #ChargeCurve
+ */
+void
+charge_curve_save (ChargeCurve *self) {
+    g_autoptr (GError) error = NULL;
+    g_autofree gchar *dirname = NULL;
+    ChargeCurveHeader header;
+    ChargeCurveEntry *entry;
+    GHashTableIter iter;
+    GByteArray *content;
+
+    if (!self->priv->changed || self->priv->filename == NULL)
+        return;
+
+    header.magic = CHARGE_CURVE_MAGIC;
+    header.version = CHARGE_CURVE_VERSION;
+    header.count = g_hash_table_size (self->priv->entries);
+
+    content = g_byte_array_new ();
+    g_byte_array_append (content, (guint8 *) &header, sizeof (header));
+
+    g_hash_table_iter_init (&iter, self->priv->entries);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+        g_byte_array_append (
+            content, (guint8 *) &entry->table, sizeof (ChargeCurveTable)
+        );
+
+    dirname = g_path_get_dirname (self->priv->filename);
+    g_mkdir_with_parents (dirname, 0755);
+
+    if (g_file_set_contents (self->priv->filename,
+                             (gchar *) content->data,
+                             content->len,
+                             &error))
+        self->priv->changed = FALSE;
+    else
+        g_warning ("Can't save charge curves: %s", error->message);
+
+    g_byte_array_unref (content);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef CHARGE_CURVE_H
+#define CHARGE_CURVE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_CHARGE_CURVE \
+    (charge_curve_get_type ())
+#define CHARGE_CURVE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_CHARGE_CURVE, ChargeCurve))
+#define CHARGE_CURVE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_CHARGE_CURVE, ChargeCurveClass))
+#define IS_CHARGE_CURVE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_CHARGE_CURVE))
+#define IS_CHARGE_CURVE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_CHARGE_CURVE))
+#define CHARGE_CURVE_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_CHARGE_CURVE, ChargeCurveClass))
+
+G_BEGIN_DECLS
+
+typedef struct _ChargeCurve ChargeCurve;
+typedef struct _ChargeCurveClass ChargeCurveClass;
+typedef struct _ChargeCurvePrivate ChargeCurvePrivate;
+
+struct _ChargeCurve {
+    GObject parent;
+    ChargeCurvePrivate *priv;
+};
+
+struct _ChargeCurveClass {
+    GObjectClass parent_class;
+};
+
+GType           charge_curve_get_type        (void) G_GNUC_CONST;
+
+GObject*        charge_curve_new             (const gchar *filename);
+void            charge_curve_set_type        (ChargeCurve *self,
+                                              const gchar *charger_type);
+void            charge_curve_reset           (ChargeCurve *self);
+void            charge_curve_add_sample      (ChargeCurve *self,
+                                              gint64       timestamp,
+                                              gdouble      percentage);
+gint64          charge_curve_get_time_to     (ChargeCurve *self,
+                                              gdouble      from,
+                                              gdouble      to);
+void            charge_curve_save            (ChargeCurve *self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "charge_model.h"
+
+#define CHARGE_MODEL_SAMPLES   16
+#define CHARGE_MODEL_ALPHA     0.3
+
+typedef struct {
+    gint64 timestamp;
+    gdouble percentage;
+    gdouble rate;
+} ChargeSample;
+
+struct _ChargeModelPrivate {
+    ChargeSample samples[CHARGE_MODEL_SAMPLES];
+    guint index;
+    guint count;
+    gint64 origin;
+
+    // Least squares sums over samples, time relative to origin
+    gdouble sum_t;
+    gdouble sum_p;
+    gdouble sum_tt;
+    gdouble sum_tp;
+
+    // Exponentially weighted rate, used until samples are available
+    gdouble rate;
+};
+
+G_DEFINE_TYPE_WITH_CODE (
+    ChargeModel,
+    charge_model,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (ChargeModel)
+)
+
+static void
+update_sums (ChargeModel  *self,
+             ChargeSample *sample,
+             gdouble       sign) {
+    gdouble t = sample->timestamp - self->priv->origin;
+
+    self->priv->sum_t += sign * t;
+    self->priv->sum_p += sign * sample->percentage;
+    self->priv->sum_tt += sign * t * t;
+    self->priv->sum_tp += sign * t * sample->percentage;
+}
+
+static void
+charge_model_dispose (GObject *charge_model)
+{
+    G_OBJECT_CLASS (charge_model_parent_class)->dispose (charge_model);
+}
+
+static void
+charge_model_finalize (GObject *charge_model)
+{
+    G_OBJECT_CLASS (charge_model_parent_class)->finalize (charge_model);
+}
+
+static void
+charge_model_class_init (ChargeModelClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = charge_model_dispose;
+    object_class->finalize = charge_model_finalize;
+}
+
+static void
+charge_model_init (ChargeModel *self)
+{
+    self->priv = charge_model_get_instance_private (self);
+
+    self->priv->rate = 0;
+    charge_model_reset (self);
+}
+
+/**
+ * charge_model_new:
+ *
+ * Creates a new #ChargeModel
+ *
+ * Returns: (transfer full): a new #ChargeModel
+ *
+ **/
+GObject *
+charge_model_new (void)
+{
+    GObject *charge_model;
+
+    charge_model = g_object_new (TYPE_CHARGE_MODEL, NULL);
+
+    return charge_model;
+}
+
+/**
+ * charge_model_reset:
+ *
+ * Drop samples, a new charging session is starting. Learnt rate is kept
+ * until new samples are available.
+ *
+ * @self: a #ChargeModel
+ */
+void
+charge_model_reset (ChargeModel *self) {
+    memset (self->priv->samples, 0, sizeof (self->priv->samples));
+    self->priv->index = 0;
+    self->priv->count = 0;
+    self->priv->origin = 0;
+    self->priv->sum_t = 0;
+    self->priv->sum_p = 0;
+    self->priv->sum_tt = 0;
+    self->priv->sum_tp = 0;
+}
+
+/**
+ * charge_model_add_sample:
+ *
+ * Add a charging sample, O(1).
+ *
+ * @self: a #ChargeModel
+ * @timestamp: sample time in seconds
+ * @percentage: battery percentage
+ */
+void
+charge_model_add_sample (ChargeModel *self,
+                         gint64       timestamp,
+                         gdouble      percentage) {
+    ChargeSample *sample = &self->priv->samples[self->priv->index];
+    ChargeSample *previous;
+    gdouble rate = 0;
+
+    if (self->priv->count == 0) {
+        self->priv->origin = timestamp;
+    } else {
+        previous = &self->priv->samples[
+            (self->priv->index + CHARGE_MODEL_SAMPLES - 1) %
+                CHARGE_MODEL_SAMPLES
+        ];
+        if (timestamp > previous->timestamp)
+            rate = (percentage - previous->percentage) /
+                (timestamp - previous->timestamp);
+    }
+
+    // Ring buffer is full, forget oldest sample
+    if (self->priv->count == CHARGE_MODEL_SAMPLES)
+        update_sums (self, sample, -1);
+    else
+        self->priv->count += 1;
+
+    sample->timestamp = timestamp;
+    sample->percentage = percentage;
+    sample->rate = rate;
+    update_sums (self, sample, 1);
+
+    self->priv->index = (self->priv->index + 1) % CHARGE_MODEL_SAMPLES;
+
+    if (rate > 0)
+        charge_model_add_rate (self, rate);
+}
+
+/**
+ * charge_model_add_rate:
+ *
+ * Add a charge rate hint (from UPower for example), O(1).
+ *
+ * @self: a #ChargeModel
+ * @rate: charge rate in percent per second
+ */
+void
+charge_model_add_rate (ChargeModel *self,
+                       gdouble      rate) {
+    if (rate <= 0)
+        return;
+
+    if (self->priv->rate == 0)
+        self->priv->rate = rate;
+    else
+        self->priv->rate = CHARGE_MODEL_ALPHA * rate +
+            (1 - CHARGE_MODEL_ALPHA) * self->priv->rate;
+}
+
+/**
+ * charge_model_get_rate:
+ *
+ * Get charge rate: least squares slope over samples or weighted rate
+ * if not enough samples.
+ *
+ * @self: a #ChargeModel
+ *
+ * Returns: charge rate in percent per second, 0 if unknown
+ */
+gdouble
+charge_model_get_rate (ChargeModel *self) {
+    gdouble n = self->priv->count;
+    gdouble denominator;
+    gdouble slope;
+
+    if (self->priv->count < 3)
+        return self->priv->rate;
+
+    denominator = n * self->priv->sum_tt -
+        self->priv->sum_t * self->priv->sum_t;
+
+    if (denominator <= 0)
+        return self->priv->rate;
+
+    slope = (n * self->priv->sum_tp -
+        self->priv->sum_t * self->priv->sum_p) / denominator;
+
+    return slope > 0 ? slope : self->priv->rate;
+}
+
+/**
+ * charge_model_get_time_to:
+ *
+ * Get time needed to charge between two percentages, O(1).
+ *
+ * @self: a #ChargeModel
+ * @from: current percentage
+ * @to: wanted percentage
+ *
+ * Returns: time in seconds, -1 if unknown
+ */
+gint64
+charge_model_get_time_to (ChargeModel *self,
+                          gdouble      from,
+                          gdouble      to) {
+    gdouble rate;
+
+    if (to <= from)
+        return 0;
+
+    rate = charge_model_get_rate (self);
+    if (rate <= 0)
+        return -1;
+
+    return (gint64) ((to - from) / rate);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef CHARGE_MODEL_H
+#define CHARGE_MODEL_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_CHARGE_MODEL \
+    (charge_model_get_type ())
+#define CHARGE_MODEL(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_CHARGE_MODEL, ChargeModel))
+#define CHARGE_MODEL_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_CHARGE_MODEL, ChargeModelClass))
+#define IS_CHARGE_MODEL(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_CHARGE_MODEL))
+#define IS_CHARGE_MODEL_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_CHARGE_MODEL))
+#define CHARGE_MODEL_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_CHARGE_MODEL, ChargeModelClass))
+
+G_BEGIN_DECLS
+
+typedef struct _ChargeModel ChargeModel;
+typedef struct _ChargeModelClass ChargeModelClass;
+typedef struct _ChargeModelPrivate ChargeModelPrivate;
+
+struct _ChargeModel {
+    GObject parent;
+    ChargeModelPrivate *priv;
+};
+
+struct _ChargeModelClass {
+    GObjectClass parent_class;
+};
+
+GType           charge_model_get_type        (void) G_GNUC_CONST;
+
+GObject*        charge_model_new             (void);
+void            charge_model_reset           (ChargeModel *self);
+void            charge_model_add_sample      (ChargeModel *self,
+                                              gint64       timestamp,
+                                              gdouble      percentage);
+void            charge_model_add_rate        (ChargeModel *self,
+                                              gdouble      rate);
+gdouble         charge_model_get_rate        (ChargeModel *self);
+gint64          charge_model_get_time_to     (ChargeModel *self,
+                                              gdouble      from,
+                                              gdouble      to);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,457 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <gio/gio.h>
+
+#include "control_group.h"
+#include "control_node.h"
+
+typedef struct {
+    ControlNode *control_node;
+    // NULL: use apply fallback value
+    gchar *values[CONTROL_GROUP_LAST];
+} ControlGroupNode;
+
+typedef struct {
+    ControlGroup *control_group;
+    ControlGroupCallback callback;
+    gpointer user_data;
+} ControlGroupReject;
+
+/*
+ * Ordered control nodes, applied as one batch. Nodes are written one
+ * after the other, a failed write rolls back already written nodes to
+ * previous state in reverse order.
+ */
+struct _ControlGroupPrivate {
+    GPtrArray *nodes;
+
+    ControlGroupState state;
+    gchar *fallback;
+
+    gboolean applying;
+    ControlGroupState apply_state;
+    gchar *apply_fallback;
+    guint apply_index;
+    gboolean rollback;
+    ControlGroupCallback callback;
+    gpointer user_data;
+};
+
+G_DEFINE_TYPE_WITH_CODE (
+    ControlGroup,
+    control_group,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (ControlGroup)
+)
+
+static void write_next_node (ControlGroup *self);
+
+static void
+control_group_node_free (ControlGroupNode *node) {
+    gint state;
+
+    for (state = 0; state < CONTROL_GROUP_LAST; state++)
+        g_free (node->values[state]);
+    g_free (node);
+}
+
+static const gchar *
+get_value (ControlGroupNode  *node,
+           ControlGroupState  state,
+           const gchar       *fallback) {
+    // Nodes without discharge value stay suspended while discharging
+    if (state == CONTROL_GROUP_DISCHARGE &&
+            node->values[CONTROL_GROUP_DISCHARGE] == NULL)
+        state = CONTROL_GROUP_SUSPEND;
+
+    if (node->values[state] != NULL)
+        return node->values[state];
+    return fallback;
+}
+
+static void
+apply_done (ControlGroup *self,
+            gboolean      applied) {
+    ControlGroupCallback callback = self->priv->callback;
+
+    if (applied) {
+        self->priv->state = self->priv->apply_state;
+        g_free (self->priv->fallback);
+        self->priv->fallback = g_steal_pointer (&self->priv->apply_fallback);
+    }
+    g_clear_pointer (&self->priv->apply_fallback, g_free);
+    self->priv->applying = FALSE;
+    self->priv->callback = NULL;
+
+    if (callback != NULL)
+        callback (self, applied, self->priv->user_data);
+}
+
+static void
+on_node_written (ControlNode *control_node,
+                 gboolean     written,
+                 gpointer     user_data) {
+    ControlGroup *self = CONTROL_GROUP (user_data);
+
+    if (self->priv->rollback) {
+        write_next_node (self);
+        return;
+    }
+
+    if (written) {
+        self->priv->apply_index += 1;
+    } else {
+        g_warning ("Control group write failed, rolling back");
+        self->priv->rollback = TRUE;
+    }
+    write_next_node (self);
+}
+
+static void
+write_next_node (ControlGroup *self) {
+    ControlGroupNode *node;
+    const gchar *value;
+
+    if (self->priv->rollback) {
+        if (self->priv->apply_index == 0) {
+            apply_done (self, FALSE);
+            return;
+        }
+        self->priv->apply_index -= 1;
+        node = g_ptr_array_index (self->priv->nodes, self->priv->apply_index);
+        value = get_value (node, self->priv->state, self->priv->fallback);
+    } else {
+        if (self->priv->apply_index >= self->priv->nodes->len) {
+            apply_done (self, TRUE);
+            return;
+        }
+        node = g_ptr_array_index (self->priv->nodes, self->priv->apply_index);
+        value = get_value (
+            node, self->priv->apply_state, self->priv->apply_fallback
+        );
+    }
+
+    // Nothing known to restore
+    if (value == NULL) {
+        on_node_written (node->control_node, !self->priv->rollback, self);
+        return;
+    }
+
+    control_node_write (node->control_node, value, on_node_written, self);
+}
+
+static gboolean
+on_apply_rejected (ControlGroupReject *reject) {
+    reject->callback (reject->control_group, FALSE, reject->user_data);
+    g_object_unref (reject->control_group);
+    g_free (reject);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+control_group_dispose (GObject *control_group)
+{
+    ControlGroup *self = CONTROL_GROUP (control_group);
+
+    g_clear_pointer (&self->priv->nodes, g_ptr_array_unref);
+    g_clear_pointer (&self->priv->fallback, g_free);
+    g_clear_pointer (&self->priv->apply_fallback, g_free);
+
+    G_OBJECT_CLASS (control_group_parent_class)->dispose (control_group);
+}
+
+static void
+control_group_finalize (GObject *control_group)
+{
+    G_OBJECT_CLASS (control_group_parent_class)->finalize (control_group);
+}
+
+static void
+control_group_class_init (ControlGroupClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = control_group_dispose;
+    object_class->finalize = control_group_finalize;
+}
+
+static void
+control_group_init (ControlGroup *self)
+{
+    self->priv = control_group_get_instance_private (self);
+
+    self->priv->nodes = g_ptr_array_new_with_free_func (
+        (GDestroyNotify) control_group_node_free
+    );
+    // Unknown state, rollback to charging
+    self->priv->state = CONTROL_GROUP_RESUME;
+    self->priv->fallback = NULL;
+    self->priv->applying = FALSE;
+    self->priv->apply_state = CONTROL_GROUP_RESUME;
+    self->priv->apply_fallback = NULL;
+    self->priv->apply_index = 0;
+    self->priv->rollback = FALSE;
+    self->priv->callback = NULL;
+    self->priv->user_data = NULL;
+}
+
+/**
+ * control_group_new:
+ *
+ * Creates a new #ControlGroup
+ *
+ * Returns: (transfer full): a new #ControlGroup
+ *
+ **/
+GObject *
+control_group_new (void)
+{
+    GObject *control_group;
+
+    control_group = g_object_new (TYPE_CONTROL_GROUP, NULL);
+
+    return control_group;
+}
+
+/**
+ * control_group_new_difference:
+ *
+ * Creates a new #ControlGroup with nodes of group not in other,
+ * sharing group state for rollbacks
+ *
+ * @self: a #ControlGroup
+ * @other: a #ControlGroup
+ *
+ * Returns: (transfer full): a new #ControlGroup
+ *
+ **/
+GObject *
+control_group_new_difference (ControlGroup *self,
+                              ControlGroup *other)
+{
+    ControlGroup *difference = CONTROL_GROUP (control_group_new ());
+    guint i, j;
+
+    for (i = 0; i < self->priv->nodes->len; i++) {
+        ControlGroupNode *node = g_ptr_array_index (self->priv->nodes, i);
+        gboolean shared = FALSE;
+
+        for (j = 0; j < other->priv->nodes->len && !shared; j++) {
+            ControlGroupNode *other_node = g_ptr_array_index (
+                other->priv->nodes, j
+            );
+
+            shared = node->control_node == other_node->control_node;
+        }
+
+        if (!shared)
+            control_group_add_node (
+                difference,
+                control_node_get_path (node->control_node),
+                node->values[CONTROL_GROUP_RESUME],
+                node->values[CONTROL_GROUP_SUSPEND],
+                node->values[CONTROL_GROUP_DISCHARGE]
+            );
+    }
+
+    difference->priv->state = self->priv->state;
+    difference->priv->fallback = g_strdup (self->priv->fallback);
+
+    return G_OBJECT (difference);
+}
+
+/**
+ * control_group_add_node:
+ *
+ * Append a node to group, nodes are written in order.
+ *
+ * @self: a #ControlGroup
+ * @path: sysfs node path
+ * @resume: value to resume charging
+ * @suspend: (nullable): value to suspend charging, fallback if NULL
+ * @discharge: (nullable): value to discharge battery
+ */
+void
+control_group_add_node (ControlGroup *self,
+                        const gchar  *path,
+                        const gchar  *resume,
+                        const gchar  *suspend,
+                        const gchar  *discharge)
+{
+    ControlGroupNode *node = g_new0 (ControlGroupNode, 1);
+
+    node->control_node = control_node_get (path);
+    node->values[CONTROL_GROUP_RESUME] = g_strdup (resume);
+    node->values[CONTROL_GROUP_SUSPEND] = g_strdup (suspend);
+    node->values[CONTROL_GROUP_DISCHARGE] = g_strdup (discharge);
+
+    g_ptr_array_add (self->priv->nodes, node);
+}
+
+/**
+ * control_group_get_length:
+ *
+ * Get number of nodes in group
+ *
+ * @self: a #ControlGroup
+ *
+ * Returns: number of nodes
+ */
+guint
+control_group_get_length (ControlGroup *self)
+{
+    return self->priv->nodes->len;
+}
+
+/**
+ * control_group_get_path:
+ *
+ * Get path of a node in group
+ *
+ * @self: a #ControlGroup
+ * @index: node index
+ *
+ * Returns: (transfer none): path to node
+ */
+const gchar *
+control_group_get_path (ControlGroup *self,
+                        guint         index)
+{
+    ControlGroupNode *node = g_ptr_array_index (self->priv->nodes, index);
+
+    return control_node_get_path (node->control_node);
+}
+
+/**
+ * control_group_can_discharge:
+ *
+ * Check if group can actively discharge battery
+ *
+ * @self: a #ControlGroup
+ *
+ * Returns: TRUE if a node has a discharge value
+ */
+gboolean
+control_group_can_discharge (ControlGroup *self)
+{
+    guint i;
+
+    for (i = 0; i < self->priv->nodes->len; i++) {
+        ControlGroupNode *node = g_ptr_array_index (self->priv->nodes, i);
+
+        if (node->values[CONTROL_GROUP_DISCHARGE] != NULL)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * control_group_apply:
+ *
+ * Write state to all nodes, in order. One apply at a time, another
+ * apply fails while nodes are written.
+ *
+ * @self: a #ControlGroup
+ * @state: a #ControlGroupState
+ * @fallback: (nullable): value for nodes without a value for state
+ * @callback: (nullable): called from main context once applied,
+ *            rolled back or rejected
+ * @user_data: callback data
+ */
+void
+control_group_apply (ControlGroup         *self,
+                     ControlGroupState     state,
+                     const gchar          *fallback,
+                     ControlGroupCallback  callback,
+                     gpointer              user_data)
+{
+    if (self->priv->applying) {
+        ControlGroupReject *reject;
+
+        g_warning ("Control group busy, apply rejected");
+        if (callback == NULL)
+            return;
+
+        reject = g_new0 (ControlGroupReject, 1);
+        reject->control_group = g_object_ref (self);
+        reject->callback = callback;
+        reject->user_data = user_data;
+        g_idle_add ((GSourceFunc) on_apply_rejected, reject);
+        return;
+    }
+
+    self->priv->applying = TRUE;
+    self->priv->apply_state = state;
+    self->priv->apply_fallback = g_strdup (fallback);
+    self->priv->apply_index = 0;
+    self->priv->rollback = FALSE;
+    self->priv->callback = callback;
+    self->priv->user_data = user_data;
+
+    write_next_node (self);
+}
+
+/**
+ * control_group_read_state:
+ *
+ * Read nodes to find current group state. Read values are cached, so
+ * applying current state again writes nothing.
+ *
+ * @self: a #ControlGroup
+ * @fallback: (nullable): value for nodes without a value for state
+ * @state: (out): current #ControlGroupState
+ *
+ * Returns: FALSE if nodes do not match a single state
+ */
+gboolean
+control_group_read_state (ControlGroup      *self,
+                          const gchar       *fallback,
+                          ControlGroupState *state)
+{
+    // Nodes without discharge value are suspended while discharging
+    const ControlGroupState states[] = {
+        CONTROL_GROUP_SUSPEND,
+        CONTROL_GROUP_DISCHARGE,
+        CONTROL_GROUP_RESUME
+    };
+    guint i, j;
+
+    g_return_val_if_fail (!self->priv->applying, FALSE);
+
+    for (i = 0; i < self->priv->nodes->len; i++) {
+        ControlGroupNode *node = g_ptr_array_index (self->priv->nodes, i);
+        g_autofree gchar *value = control_node_read (node->control_node);
+
+        if (value == NULL)
+            return FALSE;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (states); i++) {
+        gboolean matches = TRUE;
+
+        for (j = 0; j < self->priv->nodes->len && matches; j++) {
+            ControlGroupNode *node = g_ptr_array_index (self->priv->nodes, j);
+
+            matches = control_node_has_value (
+                node->control_node, get_value (node, states[i], fallback)
+            );
+        }
+
+        if (!matches)
+            continue;
+
+        // Rollbacks restore this state
+        self->priv->state = states[i];
+        g_free (self->priv->fallback);
+        self->priv->fallback = g_strdup (fallback);
+        *state = states[i];
+        return TRUE;
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef CONTROL_GROUP_H
+#define CONTROL_GROUP_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_CONTROL_GROUP \
+    (control_group_get_type ())
+#define CONTROL_GROUP(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_CONTROL_GROUP, ControlGroup))
+#define CONTROL_GROUP_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_CONTROL_GROUP, ControlGroupClass))
+#define IS_CONTROL_GROUP(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_CONTROL_GROUP))
+#define IS_CONTROL_GROUP_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_CONTROL_GROUP))
+#define CONTROL_GROUP_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_CONTROL_GROUP, ControlGroupClass))
+
+G_BEGIN_DECLS
+
+typedef enum {
+    CONTROL_GROUP_RESUME,
+    CONTROL_GROUP_SUSPEND,
+    CONTROL_GROUP_DISCHARGE,
+    CONTROL_GROUP_LAST
+} ControlGroupState;
+
+typedef struct _ControlGroup ControlGroup;
+typedef struct _ControlGroupClass ControlGroupClass;
+typedef struct _ControlGroupPrivate ControlGroupPrivate;
+
+struct _ControlGroup {
+    GObject parent;
+    ControlGroupPrivate *priv;
+};
+
+struct _ControlGroupClass {
+    GObjectClass parent_class;
+};
+
+typedef void (*ControlGroupCallback) (ControlGroup *self,
+                                      gboolean      applied,
+                                      gpointer      user_data);
+
+GType           control_group_get_type      (void) G_GNUC_CONST;
+
+GObject*        control_group_new           (void);
+GObject*        control_group_new_difference
+                                            (ControlGroup         *self,
+                                             ControlGroup         *other);
+void            control_group_add_node      (ControlGroup         *self,
+                                             const gchar          *path,
+                                             const gchar          *resume,
+                                             const gchar          *suspend,
+                                             const gchar          *discharge);
+guint           control_group_get_length    (ControlGroup         *self);
+const gchar*    control_group_get_path      (ControlGroup         *self,
+                                             guint                 index);
+gboolean        control_group_can_discharge (ControlGroup         *self);
+void            control_group_apply         (ControlGroup         *self,
+                                             ControlGroupState     state,
+                                             const gchar          *fallback,
+                                             ControlGroupCallback  callback,
+                                             gpointer              user_data);
+gboolean        control_group_read_state    (ControlGroup         *self,
+                                             const gchar          *fallback,
+                                             ControlGroupState    *state);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,524 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "control_node.h"
+#include "d-bus.h"
+
+#define CONTROL_NODE_BUFFER_SIZE 256
+
+enum {
+    PROP_0,
+    PROP_PATH
+};
+
+/*
+ * A sysfs control node, opened once. Last known node value is cached
+ * so redundant writes never reach the driver.
+ *
+ * Drivers may block on writes (PMIC behind an I2C lock...): writes run
+ * in order on a single worker thread, fd is only used by this thread.
+ * Other fields are only used from main context.
+ */
+struct _ControlNodePrivate {
+    gchar *path;
+    gint fd;
+    gchar *value;
+    GTask *pending;
+
+    guint writes;
+    guint skipped;
+    guint errors;
+    gint64 last_latency;
+    gint64 max_latency;
+};
+
+typedef struct {
+    gchar *value;
+    gboolean read_back;
+    gint superseded;
+
+    gboolean skipped;
+    gint error;
+    gint64 latency;
+
+    ControlNodeCallback callback;
+    gpointer user_data;
+} ControlWrite;
+
+static GHashTable *control_nodes = NULL;
+static GAsyncQueue *control_queue = NULL;
+
+G_DEFINE_TYPE_WITH_CODE (
+    ControlNode,
+    control_node,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (ControlNode)
+)
+
+static gboolean
+control_node_open (ControlNode *self) {
+    if (self->priv->fd >= 0)
+        return TRUE;
+
+    self->priv->fd = open (self->priv->path, O_RDWR | O_CLOEXEC);
+    // Write only attribute
+    if (self->priv->fd < 0 && errno == EACCES)
+        self->priv->fd = open (self->priv->path, O_WRONLY | O_CLOEXEC);
+
+    return self->priv->fd >= 0;
+}
+
+static void
+control_node_close (ControlNode *self) {
+    if (self->priv->fd >= 0) {
+        close (self->priv->fd);
+        self->priv->fd = -1;
+    }
+}
+
+static gchar *
+control_node_read_fd (ControlNode *self) {
+    gchar buffer[CONTROL_NODE_BUFFER_SIZE];
+    gssize size;
+
+    size = pread (self->priv->fd, buffer, sizeof (buffer) - 1, 0);
+    if (size < 0)
+        return NULL;
+
+    buffer[size] = '\0';
+    return g_strstrip (g_strdup (buffer));
+}
+
+static gboolean
+value_matches (const gchar *content,
+               const gchar *value) {
+    g_autofree gchar *selected = NULL;
+
+    if (content == NULL)
+        return FALSE;
+
+    if (g_strcmp0 (content, value) == 0)
+        return TRUE;
+
+    // Enumerations show active value between brackets: "[auto] inhibit-charge"
+    selected = g_strdup_printf ("[%s]", value);
+    return strstr (content, selected) != NULL;
+}
+
+static void
+update_statistics (ControlNode *self) {
+    GVariantBuilder builder;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (
+        &builder, "{sv}", "writes", g_variant_new_uint32 (self->priv->writes)
+    );
+    g_variant_builder_add (
+        &builder, "{sv}", "skipped", g_variant_new_uint32 (self->priv->skipped)
+    );
+    g_variant_builder_add (
+        &builder, "{sv}", "errors", g_variant_new_uint32 (self->priv->errors)
+    );
+    g_variant_builder_add (
+        &builder,
+        "{sv}",
+        "last-latency",
+        g_variant_new_int64 (self->priv->last_latency)
+    );
+    g_variant_builder_add (
+        &builder,
+        "{sv}",
+        "max-latency",
+        g_variant_new_int64 (self->priv->max_latency)
+    );
+
+    bim_bus_set_statistic (
+        bim_bus_get_default (),
+        self->priv->path,
+        g_variant_builder_end (&builder)
+    );
+}
+
+static void
+control_write_free (ControlWrite *write) {
+    g_free (write->value);
+    g_free (write);
+}
+
+/*
+ * Worker thread
+ */
+static gboolean
+control_node_write_fd (ControlNode  *self,
+                       ControlWrite *write) {
+    gint attempt;
+
+    // Unknown node value, read it back once
+    if (write->read_back && control_node_open (self)) {
+        g_autofree gchar *content = control_node_read_fd (self);
+
+        if (value_matches (content, write->value)) {
+            write->skipped = TRUE;
+            return TRUE;
+        }
+    }
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        gint64 start;
+        gssize size;
+
+        if (!control_node_open (self)) {
+            write->error = errno;
+            return FALSE;
+        }
+
+        start = g_get_monotonic_time ();
+        size = pwrite (
+            self->priv->fd, write->value, strlen (write->value), 0
+        );
+        write->error = errno;
+        write->latency = g_get_monotonic_time () - start;
+
+        if (size >= 0)
+            return TRUE;
+
+        control_node_close (self);
+
+        // Device went away and came back, retry on a new node
+        if (write->error != ENODEV)
+            break;
+    }
+
+    return FALSE;
+}
+
+static gpointer
+control_node_worker (gpointer data) {
+    while (TRUE) {
+        GTask *task = g_async_queue_pop (control_queue);
+        ControlNode *self = g_task_get_source_object (task);
+        ControlWrite *write = g_task_get_task_data (task);
+
+        if (g_atomic_int_get (&write->superseded))
+            g_task_return_new_error (
+                task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Superseded"
+            );
+        else if (control_node_write_fd (self, write))
+            g_task_return_boolean (task, TRUE);
+        else
+            g_task_return_new_error (
+                task,
+                G_IO_ERROR,
+                g_io_error_from_errno (write->error),
+                "%s",
+                g_strerror (write->error)
+            );
+
+        g_object_unref (task);
+    }
+
+    return NULL;
+}
+
+/*
+ * Main context
+ */
+static void
+on_write_done (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data) {
+    ControlNode *self = CONTROL_NODE (source_object);
+    ControlWrite *write = g_task_get_task_data (G_TASK (result));
+    g_autoptr (GError) error = NULL;
+    gboolean written;
+
+    written = g_task_propagate_boolean (G_TASK (result), &error);
+
+    if (self->priv->pending == G_TASK (result))
+        self->priv->pending = NULL;
+
+    // A newer write for this node is queued, this one did not happen
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        if (!written) {
+            g_warning (
+                "Can't write %s: %s", self->priv->path, error->message
+            );
+            g_clear_pointer (&self->priv->value, g_free);
+            self->priv->errors += 1;
+        } else if (write->skipped) {
+            self->priv->skipped += 1;
+        } else {
+            self->priv->writes += 1;
+            self->priv->last_latency = write->latency;
+            self->priv->max_latency = MAX (
+                self->priv->max_latency, write->latency
+            );
+        }
+        update_statistics (self);
+    }
+
+    if (write->callback != NULL)
+        write->callback (self, written, write->user_data);
+}
+
+static void
+control_node_set_property (GObject *object,
+                           guint property_id,
+                           const GValue *value,
+                           GParamSpec *pspec)
+{
+    ControlNode *self = CONTROL_NODE (object);
+
+    switch (property_id) {
+        case PROP_PATH:
+            self->priv->path = g_value_dup_string (value);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+control_node_dispose (GObject *control_node)
+{
+    ControlNode *self = CONTROL_NODE (control_node);
+
+    control_node_close (self);
+    g_clear_pointer (&self->priv->value, g_free);
+    g_clear_pointer (&self->priv->path, g_free);
+
+    G_OBJECT_CLASS (control_node_parent_class)->dispose (control_node);
+}
+
+static void
+control_node_finalize (GObject *control_node)
+{
+    G_OBJECT_CLASS (control_node_parent_class)->finalize (control_node);
+}
+
+static void
+control_node_class_init (ControlNodeClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = control_node_dispose;
+    object_class->finalize = control_node_finalize;
+    object_class->set_property = control_node_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_PATH,
+        g_param_spec_string (
+            "path",
+            "Path",
+            "Sysfs node path",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+}
+
+static void
+control_node_init (ControlNode *self)
+{
+    self->priv = control_node_get_instance_private (self);
+
+    self->priv->path = NULL;
+    self->priv->fd = -1;
+    self->priv->value = NULL;
+    self->priv->pending = NULL;
+    self->priv->writes = 0;
+    self->priv->skipped = 0;
+    self->priv->errors = 0;
+    self->priv->last_latency = 0;
+    self->priv->max_latency = 0;
+}
+
+/**
+ * control_node_new:
+ *
+ * Creates a new #ControlNode
+ *
+ * @path: sysfs node path
+ *
+ * Returns: (transfer full): a new #ControlNode
+ *
+ **/
+GObject *
+control_node_new (const gchar *path)
+{
+    GObject *control_node;
+
+    control_node = g_object_new (
+        TYPE_CONTROL_NODE, "path", path, NULL
+    );
+
+    return control_node;
+}
+
+/**
+ * control_node_get:
+ *
+ * Gets the #ControlNode for path, shared by all users of the node.
+ *
+ * @path: sysfs node path
+ *
+ * Returns: (transfer none): a #ControlNode
+ */
+ControlNode *
+control_node_get (const gchar *path)
+{
+    ControlNode *control_node;
+
+    if (control_nodes == NULL)
+        control_nodes = g_hash_table_new_full (
+            g_str_hash, g_str_equal, g_free, g_object_unref
+        );
+
+    control_node = g_hash_table_lookup (control_nodes, path);
+    if (control_node == NULL) {
+        control_node = CONTROL_NODE (control_node_new (path));
+        g_hash_table_insert (control_nodes, g_strdup (path), control_node);
+    }
+
+    return control_node;
+}
+
+/**
+ * control_node_get_path:
+ *
+ * Get node path
+ *
+ * @self: a #ControlNode
+ *
+ * Returns: (transfer none): path to node
+ */
+const gchar *
+control_node_get_path (ControlNode *self)
+{
+    return self->priv->path;
+}
+
+/**
+ * control_node_write:
+ *
+ * Queue a write to node, skipped if node already has this value. Writes
+ * to all nodes happen in order, a queued write to a node is dropped when
+ * a newer one is queued.
+ *
+ * @self: a #ControlNode
+ * @value: value to write
+ * @callback: (nullable): called from main context once written,
+ *            with written FALSE for failed or dropped writes
+ * @user_data: callback data
+ */
+void
+control_node_write (ControlNode         *self,
+                    const gchar         *value,
+                    ControlNodeCallback  callback,
+                    gpointer             user_data)
+{
+    ControlWrite *write = g_new0 (ControlWrite, 1);
+    GTask *task = g_task_new (self, NULL, on_write_done, NULL);
+
+    write->value = g_strdup (value);
+    write->read_back = self->priv->value == NULL;
+    write->callback = callback;
+    write->user_data = user_data;
+    g_task_set_task_data (task, write, (GDestroyNotify) control_write_free);
+
+    if (value_matches (self->priv->value, value)) {
+        write->skipped = TRUE;
+        g_task_return_boolean (task, TRUE);
+        g_object_unref (task);
+        return;
+    }
+
+    if (self->priv->pending != NULL) {
+        ControlWrite *pending = g_task_get_task_data (self->priv->pending);
+
+        g_atomic_int_set (&pending->superseded, TRUE);
+    }
+
+    g_free (self->priv->value);
+    self->priv->value = g_strdup (value);
+    self->priv->pending = task;
+
+    if (control_queue == NULL) {
+        control_queue = g_async_queue_new ();
+        g_thread_unref (
+            g_thread_new ("control-node", control_node_worker, NULL)
+        );
+    }
+    g_async_queue_push (control_queue, task);
+}
+
+/**
+ * control_node_invalidate:
+ *
+ * Forget known node value, ie when a driver may have reset it. Next
+ * write reads node back before writing.
+ *
+ * @self: a #ControlNode
+ */
+void
+control_node_invalidate (ControlNode *self)
+{
+    g_clear_pointer (&self->priv->value, g_free);
+}
+
+/**
+ * control_node_has_value:
+ *
+ * Check node known value, as last read or written.
+ *
+ * @self: a #ControlNode
+ * @value: value to check
+ *
+ * Returns: TRUE if node has value
+ */
+gboolean
+control_node_has_value (ControlNode *self,
+                        const gchar *value)
+{
+    return value != NULL && value_matches (self->priv->value, value);
+}
+
+/**
+ * control_node_read:
+ *
+ * Read node value, also refreshing cached value.
+ *
+ * @self: a #ControlNode
+ *
+ * Returns: (transfer full) (nullable): stripped node value
+ */
+gchar *
+control_node_read (ControlNode *self)
+{
+    gchar *value = NULL;
+
+    if (!g_file_get_contents (self->priv->path, &value, NULL, NULL))
+        return NULL;
+
+    g_strstrip (value);
+
+    // Queued writes are newer than node value
+    if (self->priv->pending == NULL) {
+        g_free (self->priv->value);
+        self->priv->value = g_strdup (value);
+    }
+
+    return value;
+}
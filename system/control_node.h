@@ -0,0 +1,64 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef CONTROL_NODE_H
+#define CONTROL_NODE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_CONTROL_NODE \
+    (control_node_get_type ())
+#define CONTROL_NODE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_CONTROL_NODE, ControlNode))
+#define CONTROL_NODE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_CONTROL_NODE, ControlNodeClass))
+#define IS_CONTROL_NODE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_CONTROL_NODE))
+#define IS_CONTROL_NODE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_CONTROL_NODE))
+#define CONTROL_NODE_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_CONTROL_NODE, ControlNodeClass))
+
+G_BEGIN_DECLS
+
+typedef struct _ControlNode ControlNode;
+typedef struct _ControlNodeClass ControlNodeClass;
+typedef struct _ControlNodePrivate ControlNodePrivate;
+
+struct _ControlNode {
+    GObject parent;
+    ControlNodePrivate *priv;
+};
+
+struct _ControlNodeClass {
+    GObjectClass parent_class;
+};
+
+typedef void (*ControlNodeCallback) (ControlNode *self,
+                                     gboolean     written,
+                                     gpointer     user_data);
+
+GType           control_node_get_type (void) G_GNUC_CONST;
+
+GObject*        control_node_new      (const gchar *path);
+ControlNode*    control_node_get      (const gchar *path);
+const gchar*    control_node_get_path (ControlNode *self);
+void            control_node_write    (ControlNode         *self,
+                                       const gchar         *value,
+                                       ControlNodeCallback  callback,
+                                       gpointer             user_data);
+void            control_node_invalidate (ControlNode *self);
+gboolean        control_node_has_value (ControlNode *self,
+                                       const gchar *value);
+gchar*          control_node_read     (ControlNode *self);
+
+G_END_DECLS
+
+#endif
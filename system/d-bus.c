@@ -18,6 +18,7 @@ enum
     ALARM_ADDED,
     ALARM_REMOVED,
     SETTING_CHANGED,
+    THRESHOLDS_CHANGED,
     LAST_SIGNAL
 };
 
@@ -29,6 +30,14 @@ struct _BimBusPrivate {
     guint owner_id;
     
     GList *alarms;
+    GHashTable *statistics;
+    gint64 start_time;
+
+    gchar *control_class;
+    gchar *control_path;
+
+    // Signal sent before bus is acquired
+    GVariant *input_suspended;
 };
 
 G_DEFINE_TYPE_WITH_CODE (BimBus, bim_bus, G_TYPE_OBJECT,
@@ -49,6 +58,14 @@ sort_alarms (gconstpointer a,
     return a_time - b_time;
 }
 
+static gboolean
+thresholds_are_valid (gint max,
+                      gint start,
+                      gint end)
+{
+    return start >= 0 && start < end && end <= max && max <= 100;
+}
+
 static void
 handle_method_call (GDBusConnection *connection,
                     const gchar *sender,
@@ -112,6 +129,109 @@ handle_method_call (GDBusConnection *connection,
         g_dbus_method_invocation_return_value (
             invocation, NULL
         );
+    } else if (g_strcmp0 (method_name, "SetThresholds") == 0) {
+        gint max, start, end;
+
+        g_variant_get (parameters, "(iii)", &max, &start, &end);
+
+        if (!thresholds_are_valid (max, start, end)) {
+            g_dbus_method_invocation_return_error (
+                invocation,
+                G_DBUS_ERROR,
+                G_DBUS_ERROR_INVALID_ARGS,
+                "Invalid thresholds: %d %d %d",
+                max, start, end
+            );
+            return;
+        }
+
+        g_signal_emit(
+            self, signals[THRESHOLDS_CHANGED], 0, max, start, end
+        );
+
+        g_dbus_method_invocation_return_value (
+            invocation, NULL
+        );
+    } else if (g_strcmp0 (method_name, "SetSettings") == 0) {
+        g_autoptr (GVariant) settings = NULL;
+        GVariantIter iter;
+        const gchar *setting;
+        gint value;
+        gint max = 0, start = 0, end = 0;
+        guint thresholds = 0;
+
+        g_variant_get (parameters, "(@a{si})", &settings);
+
+        thresholds += g_variant_lookup (settings, "threshold-max", "i", &max);
+        thresholds += g_variant_lookup (
+            settings, "threshold-start", "i", &start
+        );
+        thresholds += g_variant_lookup (settings, "threshold-end", "i", &end);
+
+        // Thresholds only make sense together
+        if (thresholds != 0 &&
+                (thresholds != 3 || !thresholds_are_valid (max, start, end))) {
+            g_dbus_method_invocation_return_error (
+                invocation,
+                G_DBUS_ERROR,
+                G_DBUS_ERROR_INVALID_ARGS,
+                "Invalid thresholds: %d %d %d",
+                max, start, end
+            );
+            return;
+        }
+
+        // Emitted in one go, listeners re-plan once
+        g_variant_iter_init (&iter, settings);
+        while (g_variant_iter_next (&iter, "{&si}", &setting, &value))
+            if (!g_str_has_prefix (setting, "threshold-"))
+                g_signal_emit (
+                    self, signals[SETTING_CHANGED], 0, setting, value
+                );
+
+        if (thresholds != 0)
+            g_signal_emit (
+                self, signals[THRESHOLDS_CHANGED], 0, max, start, end
+            );
+
+        g_dbus_method_invocation_return_value (
+            invocation, NULL
+        );
+    } else if (g_strcmp0 (method_name, "GetControl") == 0) {
+        // Published by control loops, nodes actually driven
+        g_dbus_method_invocation_return_value (
+            invocation,
+            g_variant_new (
+                "(ss)",
+                self->priv->control_class != NULL ?
+                    self->priv->control_class : "",
+                self->priv->control_path != NULL ?
+                    self->priv->control_path : ""
+            )
+        );
+    } else if (g_strcmp0 (method_name, "GetStatistics") == 0) {
+        GVariantBuilder builder;
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+        g_variant_builder_add (
+            &builder,
+            "{sv}",
+            "uptime",
+            g_variant_new_int64 (
+                (g_get_monotonic_time () - self->priv->start_time) /
+                    G_USEC_PER_SEC
+            )
+        );
+
+        g_hash_table_iter_init (&iter, self->priv->statistics);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+            g_variant_builder_add (&builder, "{sv}", key, value);
+
+        g_dbus_method_invocation_return_value (
+            invocation, g_variant_new ("(a{sv})", &builder)
+        );
     } else if (g_strcmp0 (method_name, "Quit") == 0) {
         g_dbus_method_invocation_return_value (
             invocation, NULL
@@ -148,6 +268,19 @@ on_bus_acquired (GDBusConnection *connection,
     self->priv->connection = g_object_ref (connection);
 
     g_assert (registration_id > 0);
+
+    if (self->priv->input_suspended != NULL) {
+        g_dbus_connection_emit_signal (
+            self->priv->connection,
+            NULL,
+            DBUS_PATH,
+            DBUS_NAME,
+            "InputSuspended",
+            self->priv->input_suspended,
+            NULL
+        );
+        g_clear_pointer (&self->priv->input_suspended, g_variant_unref);
+    }
 }
 
 static void
@@ -200,6 +333,10 @@ bim_bus_dispose (GObject *bim_bus)
     }
 
     g_list_free_full (self->priv->alarms, g_free);
+    g_clear_pointer (&self->priv->statistics, g_hash_table_unref);
+    g_clear_pointer (&self->priv->control_class, g_free);
+    g_clear_pointer (&self->priv->control_path, g_free);
+    g_clear_pointer (&self->priv->input_suspended, g_variant_unref);
     g_clear_pointer (&self->priv->introspection_data, g_dbus_node_info_unref);
     g_clear_object (&self->priv->connection);
 
@@ -256,6 +393,19 @@ bim_bus_class_init (BimBusClass *klass)
         G_TYPE_INT
     );
 
+    signals[THRESHOLDS_CHANGED] = g_signal_new (
+        "thresholds-changed",
+        G_OBJECT_CLASS_TYPE (object_class),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL, NULL, NULL,
+        G_TYPE_NONE,
+        3,
+        G_TYPE_INT,
+        G_TYPE_INT,
+        G_TYPE_INT
+    );
+
 }
 
 static void
@@ -290,6 +440,13 @@ bim_bus_init (BimBus *self)
     );
 
     self->priv->alarms = NULL;
+    self->priv->statistics = g_hash_table_new_full (
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_variant_unref
+    );
+    self->priv->start_time = g_get_monotonic_time ();
+    self->priv->control_class = NULL;
+    self->priv->control_path = NULL;
+    self->priv->input_suspended = NULL;
 }
 
 /**
@@ -343,11 +500,7 @@ gint64
 bim_bus_get_next_alarm (BimBus *self) {
     gint64 timestamp = 0;
     GVariant *alarm;
-    g_autoptr(GDateTime) datetime;
-    gint64 current_timestamp;
-
-    datetime = g_date_time_new_now_utc ();
-    current_timestamp = g_date_time_to_unix (datetime);
+    gint64 current_timestamp = g_get_real_time () / G_USEC_PER_SEC;
 
     GFOREACH (self->priv->alarms, alarm) {
         g_variant_get (alarm, "(&sx)", NULL, &timestamp);
@@ -365,13 +518,63 @@ bim_bus_input_suspended (BimBus *self,
                          gboolean suspended,
                          gint64   timestamp)
 {
+    GVariant *parameters = g_variant_new ("(bx)", suspended, timestamp);
+
+    // Startup state, only last one matters
+    if (self->priv->connection == NULL) {
+        g_clear_pointer (&self->priv->input_suspended, g_variant_unref);
+        self->priv->input_suspended = g_variant_ref_sink (parameters);
+        return;
+    }
+
     g_dbus_connection_emit_signal (
         self->priv->connection,
         NULL,
         DBUS_PATH,
         DBUS_NAME,
         "InputSuspended",
-        g_variant_new ("(bx)", suspended, timestamp),
+        parameters,
         NULL
     );
-}
\ No newline at end of file
+}
+
+/**
+ * bim_bus_set_statistic:
+ *
+ * Update a statistic exposed by GetStatistics.
+ *
+ * @self: a #BimBus
+ * @key: statistic name
+ * @value: (transfer floating): statistic value
+ */
+void
+bim_bus_set_statistic (BimBus      *self,
+                       const gchar *key,
+                       GVariant    *value)
+{
+    g_hash_table_replace (
+        self->priv->statistics,
+        g_strdup (key),
+        g_variant_ref_sink (value)
+    );
+}
+
+/**
+ * bim_bus_set_control:
+ *
+ * Update control exposed by GetControl, last driven nodes win.
+ *
+ * @self: a #BimBus
+ * @control_class: control class
+ * @path: (nullable): driven node path
+ */
+void
+bim_bus_set_control (BimBus      *self,
+                     const gchar *control_class,
+                     const gchar *path)
+{
+    g_free (self->priv->control_class);
+    g_free (self->priv->control_path);
+    self->priv->control_class = g_strdup (control_class);
+    self->priv->control_path = g_strdup (path);
+}
@@ -48,6 +48,12 @@ gint64      bim_bus_get_next_alarm  (BimBus *self);
 void        bim_bus_input_suspended (BimBus *self,
                                      gboolean suspended,
                                      gint64   timestamp);
+void        bim_bus_set_statistic   (BimBus      *self,
+                                     const gchar *key,
+                                     GVariant    *value);
+void        bim_bus_set_control     (BimBus      *self,
+                                     const gchar *control_class,
+                                     const gchar *path);
 G_END_DECLS
 
 #endif
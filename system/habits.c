@@ -0,0 +1,327 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "habits.h"
+
+#define HABITS_MAGIC       0x4d494248
+#define HABITS_VERSION     1
+#define HABITS_DAYS        7
+#define HABITS_HOURS       24
+#define HABITS_MAX_COUNT   G_MAXUINT16
+// Needed unplugs at an hour before trusting it
+#define HABITS_MIN_COUNT   3
+// Needed share of weekday unplugs at an hour, in percent
+#define HABITS_MIN_SHARE   30
+
+enum {
+    PROP_0,
+    PROP_FILENAME
+};
+
+typedef struct {
+    guint32 magic;
+    guint32 version;
+} HabitsHeader;
+
+/*
+ * Unplug histogram by local weekday and hour. Totals and most
+ * frequent hour per weekday are kept up to date on each unplug,
+ * so prediction never scans the histogram.
+ */
+struct _HabitsPrivate {
+    gchar *filename;
+
+    guint16 counts[HABITS_DAYS][HABITS_HOURS];
+    guint32 totals[HABITS_DAYS];
+    guint8 argmax[HABITS_DAYS];
+
+    gboolean changed;
+};
+
+G_DEFINE_TYPE_WITH_CODE (
+    Habits,
+    habits,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (Habits)
+)
+
+static void
+update_day (Habits *self,
+            gint    day) {
+    gint hour;
+
+    self->priv->totals[day] = 0;
+    self->priv->argmax[day] = 0;
+    for (hour = 0; hour < HABITS_HOURS; hour++) {
+        self->priv->totals[day] += self->priv->counts[day][hour];
+        if (self->priv->counts[day][hour] >
+                self->priv->counts[day][self->priv->argmax[day]])
+            self->priv->argmax[day] = hour;
+    }
+}
+
+static gboolean
+is_habit (Habits *self,
+          gint    day) {
+    guint32 count = self->priv->counts[day][self->priv->argmax[day]];
+
+    return count >= HABITS_MIN_COUNT &&
+        count * 100 >= self->priv->totals[day] * HABITS_MIN_SHARE;
+}
+
+static void
+habits_load (Habits *self) {
+    g_autoptr (GError) error = NULL;
+    g_autofree gchar *content = NULL;
+    HabitsHeader *header;
+    gsize size;
+    gint day;
+
+    if (self->priv->filename == NULL)
+        return;
+
+    if (!g_file_get_contents (self->priv->filename, &content, &size, &error)) {
+        g_message ("No habits: %s", error->message);
+        return;
+    }
+
+    header = (HabitsHeader *) content;
+    if (size != sizeof (HabitsHeader) + sizeof (self->priv->counts) ||
+            header->magic != HABITS_MAGIC ||
+            header->version != HABITS_VERSION) {
+        g_warning ("Invalid habits file: %s", self->priv->filename);
+        return;
+    }
+
+    memcpy (
+        self->priv->counts,
+        content + sizeof (HabitsHeader),
+        sizeof (self->priv->counts)
+    );
+
+    for (day = 0; day < HABITS_DAYS; day++)
+        update_day (self, day);
+}
+
+static void
+habits_set_property (GObject *object,
+                     guint property_id,
+                     const GValue *value,
+                     GParamSpec *pspec)
+{
+    Habits *self = HABITS (object);
+
+    switch (property_id) {
+        case PROP_FILENAME:
+            self->priv->filename = g_value_dup_string (value);
+            habits_load (self);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+habits_dispose (GObject *habits)
+{
+    Habits *self = HABITS (habits);
+
+    habits_save (self);
+
+    g_clear_pointer (&self->priv->filename, g_free);
+
+    G_OBJECT_CLASS (habits_parent_class)->dispose (habits);
+}
+
+static void
+habits_finalize (GObject *habits)
+{
+    G_OBJECT_CLASS (habits_parent_class)->finalize (habits);
+}
+
+static void
+habits_class_init (HabitsClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = habits_dispose;
+    object_class->finalize = habits_finalize;
+    object_class->set_property = habits_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_FILENAME,
+        g_param_spec_string (
+            "filename",
+            "Habits file",
+            "Habits file",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+}
+
+static void
+habits_init (Habits *self)
+{
+    self->priv = habits_get_instance_private (self);
+
+    self->priv->filename = NULL;
+    memset (self->priv->counts, 0, sizeof (self->priv->counts));
+    memset (self->priv->totals, 0, sizeof (self->priv->totals));
+    memset (self->priv->argmax, 0, sizeof (self->priv->argmax));
+    self->priv->changed = FALSE;
+}
+
+/**
+ * habits_new:
+ *
+ * Creates a new #Habits
+ *
+ * @filename: (nullable): file used to persist habits
+ *
+ * Returns: (transfer full): a new #Habits
+ *
+ **/
+GObject *
+habits_new (const gchar *filename)
+{
+    GObject *habits;
+
+    habits = g_object_new (
+        TYPE_HABITS, "filename", filename, NULL
+    );
+
+    return habits;
+}
+
+/**
+ * habits_add_unplug:
+ *
+ * Learn an unplug event
+ *
+ * @self: a #Habits
+ * @timestamp: UTC timestamp of unplug
+ */
+void
+habits_add_unplug (Habits *self,
+                   gint64  timestamp) {
+    g_autoptr (GDateTime) datetime = g_date_time_new_from_unix_local (
+        timestamp
+    );
+    gint day = g_date_time_get_day_of_week (datetime) - 1;
+    gint hour = g_date_time_get_hour (datetime);
+
+    // Forget old habits when saturated
+    if (self->priv->counts[day][hour] == HABITS_MAX_COUNT) {
+        gint i;
+
+        for (i = 0; i < HABITS_HOURS; i++)
+            self->priv->counts[day][i] /= 2;
+        update_day (self, day);
+    }
+
+    self->priv->counts[day][hour] += 1;
+    self->priv->totals[day] += 1;
+    if (self->priv->counts[day][hour] >
+            self->priv->counts[day][self->priv->argmax[day]])
+        self->priv->argmax[day] = hour;
+
+    self->priv->changed = TRUE;
+}
+
+/**
+ * habits_get_next_unplug:
+ *
+ * Predict next unplug from learnt habits
+ *
+ * @self: a #Habits
+ * @timestamp: current UTC timestamp
+ *
+ * Returns: UTC timestamp of next predicted unplug, 0 if none
+ */
+gint64
+habits_get_next_unplug (Habits *self,
+                        gint64  timestamp) {
+    g_autoptr (GDateTime) now = g_date_time_new_from_unix_local (timestamp);
+    gint day = g_date_time_get_day_of_week (now) - 1;
+    gint offset;
+
+    for (offset = 0; offset <= HABITS_DAYS; offset++) {
+        g_autoptr (GDateTime) date = NULL;
+        g_autoptr (GDateTime) unplug = NULL;
+        gint weekday = (day + offset) % HABITS_DAYS;
+        gint64 unplug_timestamp;
+
+        if (!is_habit (self, weekday))
+            continue;
+
+        date = g_date_time_add_days (now, offset);
+        unplug = g_date_time_new_local (
+            g_date_time_get_year (date),
+            g_date_time_get_month (date),
+            g_date_time_get_day_of_month (date),
+            self->priv->argmax[weekday],
+            0,
+            0
+        );
+        if (unplug == NULL)
+            continue;
+
+        unplug_timestamp = g_date_time_to_unix (unplug);
+        if (unplug_timestamp > timestamp)
+            return unplug_timestamp;
+    }
+
+    return 0;
+}
+
+/**
+ * habits_save:
+ *
+ * Save habits if changed
+ *
+ * @self: a #Habits
+ */
+void
+habits_save (Habits *self) {
+    g_autoptr (GError) error = NULL;
+    g_autofree gchar *dirname = NULL;
+    HabitsHeader header;
+    GByteArray *content;
+
+    if (!self->priv->changed || self->priv->filename == NULL)
+        return;
+
+    header.magic = HABITS_MAGIC;
+    header.version = HABITS_VERSION;
+
+    content = g_byte_array_new ();
+    g_byte_array_append (content, (guint8 *) &header, sizeof (header));
+    g_byte_array_append (
+        content,
+        (guint8 *) self->priv->counts,
+        sizeof (self->priv->counts)
+    );
+
+    dirname = g_path_get_dirname (self->priv->filename);
+    g_mkdir_with_parents (dirname, 0755);
+
+    if (g_file_set_contents (self->priv->filename,
+                             (gchar *) content->data,
+                             content->len,
+                             &error))
+        self->priv->changed = FALSE;
+    else
+        g_warning ("Can't save habits: %s", error->message);
+
+    g_byte_array_unref (content);
+}
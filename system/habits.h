@@ -0,0 +1,55 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef HABITS_H
+#define HABITS_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_HABITS \
+    (habits_get_type ())
+#define HABITS(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_HABITS, Habits))
+#define HABITS_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_HABITS, HabitsClass))
+#define IS_HABITS(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_HABITS))
+#define IS_HABITS_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_HABITS))
+#define HABITS_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_HABITS, HabitsClass))
+
+G_BEGIN_DECLS
+
+typedef struct _Habits Habits;
+typedef struct _HabitsClass HabitsClass;
+typedef struct _HabitsPrivate HabitsPrivate;
+
+struct _Habits {
+    GObject parent;
+    HabitsPrivate *priv;
+};
+
+struct _HabitsClass {
+    GObjectClass parent_class;
+};
+
+GType           habits_get_type        (void) G_GNUC_CONST;
+
+GObject*        habits_new             (const gchar *filename);
+void            habits_add_unplug      (Habits      *self,
+                                        gint64       timestamp);
+gint64          habits_get_next_unplug (Habits      *self,
+                                        gint64       timestamp);
+void            habits_save            (Habits      *self);
+
+G_END_DECLS
+
+#endif
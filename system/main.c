@@ -10,9 +10,96 @@
 #include <stdlib.h>
 
 #include "d-bus.h"
+#include "power_supply.h"
+#include "settings.h"
 #include "suspend.h"
+#include "sysfs_source.h"
+#include "trace_source.h"
+#include "upower_source.h"
+#include "wake_alarm.h"
 
 static GMainLoop *loop;
+static gint64 startup_time;
+
+static const gchar *SOURCE_NAMES[] = {
+    "upower",
+    "sysfs",
+    "trace",
+    NULL
+};
+
+static gboolean
+on_started (gpointer user_data) {
+    gint64 elapsed = (g_get_monotonic_time () - startup_time) / 1000;
+
+    g_message ("Started in %ld ms", (long) elapsed);
+    bim_bus_set_statistic (
+        bim_bus_get_default (),
+        "startup-time",
+        g_variant_new_int64 (elapsed)
+    );
+
+    return G_SOURCE_REMOVE;
+}
+
+static BatterySource *
+new_source (const gchar *source_name,
+            const gchar *battery) {
+    if (g_strcmp0 (source_name, "sysfs") == 0)
+        return BATTERY_SOURCE (sysfs_source_new (battery));
+    return BATTERY_SOURCE (upower_source_new (battery));
+}
+
+static GObject *
+new_suspend (BatterySource *source,
+             Settings      *settings,
+             gboolean       simulate) {
+    GObject *suspend = suspend_new (source, settings, simulate);
+
+    g_object_unref (source);
+    g_object_unref (settings);
+
+    return suspend;
+}
+
+/*
+ * One control loop per battery owning control nodes, all loops share
+ * the timer wheel. Falls back to a single loop on aggregated battery.
+ */
+static GList *
+new_suspends (const gchar *source_name) {
+    g_auto (GStrv) batteries = power_supply_get_batteries ();
+    GList *suspends = NULL;
+    gint i;
+
+    if (g_strv_length (batteries) > 1) {
+        for (i = 0; batteries[i] != NULL; i++) {
+            Settings *settings = SETTINGS (settings_new (batteries[i]));
+
+            if (!settings_has_control (settings)) {
+                g_object_unref (settings);
+                continue;
+            }
+
+            suspends = g_list_prepend (
+                suspends,
+                new_suspend (
+                    new_source (source_name, batteries[i]), settings, FALSE
+                )
+            );
+        }
+    }
+
+    if (suspends == NULL)
+        suspends = g_list_prepend (
+            suspends,
+            new_suspend (
+                new_source (source_name, NULL), settings_get_default (), FALSE
+            )
+        );
+
+    return suspends;
+}
 
 static void
 sigint_handler(int dummy) {
@@ -22,19 +109,31 @@ sigint_handler(int dummy) {
 gint
 main (gint argc, gchar * argv[])
 {
-    Suspend *suspend;
+    GList *suspends = NULL;
 
     GResource *resource;
     g_autoptr (GOptionContext) context = NULL;
     g_autoptr (GError) error = NULL;
     gboolean version = FALSE;
     gboolean simulate = FALSE;
+    g_autofree gchar *logind_address = NULL;
+    g_autofree gchar *rtc_wakealarm = NULL;
+    g_autofree gchar *source_name = NULL;
+    g_autofree gchar *sysfs_root = NULL;
+    g_autofree gchar *trace = NULL;
     GOptionEntry main_entries[] = {
         {"simulate", 0, 0, G_OPTION_ARG_NONE, &simulate, "Simulate charge cycle"},
+        {"source", 0, 0, G_OPTION_ARG_STRING, &source_name, "Battery source: upower (default), sysfs or trace"},
+        {"sysfs-root", 0, 0, G_OPTION_ARG_FILENAME, &sysfs_root, "Read power supplies from this directory"},
+        {"trace", 0, 0, G_OPTION_ARG_FILENAME, &trace, "Battery trace to replay"},
+        {"logind-address", 0, 0, G_OPTION_ARG_STRING, &logind_address, "D-Bus address to reach logind on"},
+        {"rtc-wakealarm", 0, 0, G_OPTION_ARG_FILENAME, &rtc_wakealarm, "Use this RTC wakealarm node for wake alarms"},
         {"version", 0, 0, G_OPTION_ARG_NONE, &version, "Show version"},
         {NULL}
     };
 
+    startup_time = g_get_monotonic_time ();
+
     signal(SIGINT, sigint_handler);
 
     context = g_option_context_new ("Battery Input Manager");
@@ -50,17 +149,41 @@ main (gint argc, gchar * argv[])
         return EXIT_SUCCESS;
     }
 
+    if (source_name != NULL && !g_strv_contains (SOURCE_NAMES, source_name)) {
+        g_printerr ("Unknown battery source: %s\n", source_name);
+        return EXIT_FAILURE;
+    }
+
     resource = g_resource_load (BIM_RESOURCES, NULL);
     g_resources_register (resource);
 
+    power_supply_set_root (sysfs_root);
+
     bim_bus_get_default ();
-    suspend = SUSPEND (suspend_new (simulate));
+    wake_alarm_connect (
+        wake_alarm_get_default (), logind_address, rtc_wakealarm
+    );
+    if (trace != NULL || g_strcmp0 (source_name, "trace") == 0)
+        simulate = TRUE;
+
+    if (simulate)
+        suspends = g_list_prepend (
+            suspends,
+            new_suspend (
+                BATTERY_SOURCE (trace_source_new (trace)),
+                settings_get_default (),
+                TRUE
+            )
+        );
+    else
+        suspends = new_suspends (source_name);
 
     loop = g_main_loop_new (NULL, FALSE);
+    g_idle_add (on_started, NULL);
     g_main_loop_run (loop);
 
     g_clear_pointer (&loop, g_main_loop_unref);
-    g_clear_object (&suspend);
+    g_list_free_full (suspends, g_object_unref);
 
     return EXIT_SUCCESS;
 }
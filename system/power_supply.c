@@ -0,0 +1,248 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "power_supply.h"
+
+static gchar *power_supply_root = NULL;
+
+static gchar*
+read_attribute (const gchar *supply,
+                const gchar *attribute) {
+    g_autofree gchar *path = NULL;
+    gchar *content = NULL;
+
+    path = g_build_filename (
+        power_supply_get_root (), supply, attribute, NULL
+    );
+
+    if (!g_file_get_contents (path, &content, NULL, NULL))
+        return NULL;
+
+    return g_strstrip (content);
+}
+
+/**
+ * power_supply_set_root:
+ *
+ * Read power supplies from another directory, used to run against
+ * a fake sysfs tree.
+ *
+ * @root: (nullable): power_supply class directory, default if NULL
+ */
+void
+power_supply_set_root (const gchar *root) {
+    g_free (power_supply_root);
+    power_supply_root = g_strdup (root);
+}
+
+/**
+ * power_supply_get_root:
+ *
+ * Get power_supply class directory.
+ *
+ * Returns: (transfer none): power_supply class directory
+ */
+const gchar*
+power_supply_get_root (void) {
+    if (power_supply_root != NULL)
+        return power_supply_root;
+    return POWER_SUPPLY_PATH;
+}
+
+/**
+ * power_supply_get_attribute:
+ *
+ * Read a power supply attribute.
+ *
+ * @supply: power supply name
+ * @attribute: attribute name
+ *
+ * Returns: (transfer full) (nullable): stripped attribute value
+ */
+gchar*
+power_supply_get_attribute (const gchar *supply,
+                            const gchar *attribute) {
+    return read_attribute (supply, attribute);
+}
+
+/**
+ * power_supply_get_batteries:
+ *
+ * Get system batteries, peripheral batteries are ignored.
+ *
+ * Returns: (transfer full): NULL terminated battery power supply names
+ */
+gchar**
+power_supply_get_batteries (void) {
+    g_autoptr(GDir) dir = NULL;
+    GPtrArray *batteries = g_ptr_array_new ();
+    const gchar *supply;
+
+    dir = g_dir_open (power_supply_get_root (), 0, NULL);
+
+    while (dir != NULL && (supply = g_dir_read_name (dir)) != NULL) {
+        g_autofree gchar *type = read_attribute (supply, "type");
+        g_autofree gchar *scope = read_attribute (supply, "scope");
+
+        if (g_strcmp0 (type, "Battery") != 0)
+            continue;
+
+        if (g_strcmp0 (scope, "Device") == 0)
+            continue;
+
+        g_ptr_array_add (batteries, g_strdup (supply));
+    }
+
+    g_ptr_array_add (batteries, NULL);
+
+    return (gchar **) g_ptr_array_free (batteries, FALSE);
+}
+
+/**
+ * power_supply_get_battery:
+ *
+ * Get first system battery, peripheral batteries are ignored.
+ *
+ * Returns: (transfer full) (nullable): battery power supply name
+ */
+gchar*
+power_supply_get_battery (void) {
+    g_auto (GStrv) batteries = power_supply_get_batteries ();
+
+    return g_strdup (batteries[0]);
+}
+
+/**
+ * power_supply_get_online:
+ *
+ * Check if a charger is plugged using power_supply online nodes.
+ *
+ * @online: (out): TRUE if an input is online
+ *
+ * Returns: FALSE if no charger online node is available
+ */
+gboolean
+power_supply_get_online (gboolean *online) {
+    g_autoptr(GDir) dir = NULL;
+    const gchar *supply;
+    gboolean found = FALSE;
+
+    *online = FALSE;
+
+    dir = g_dir_open (power_supply_get_root (), 0, NULL);
+    if (dir == NULL)
+        return FALSE;
+
+    while ((supply = g_dir_read_name (dir)) != NULL) {
+        g_autofree gchar *type = read_attribute (supply, "type");
+        g_autofree gchar *value = NULL;
+
+        if (type == NULL || g_strcmp0 (type, "Battery") == 0)
+            continue;
+
+        value = read_attribute (supply, "online");
+        if (value == NULL)
+            continue;
+
+        found = TRUE;
+        if (g_strcmp0 (value, "0") != 0) {
+            *online = TRUE;
+            break;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * power_supply_get_online_input:
+ *
+ * Get charger input currently powering the device.
+ *
+ * Returns: (transfer full) (nullable): online power supply name
+ */
+gchar*
+power_supply_get_online_input (void) {
+    g_autoptr(GDir) dir = NULL;
+    const gchar *supply;
+
+    dir = g_dir_open (power_supply_get_root (), 0, NULL);
+    if (dir == NULL)
+        return NULL;
+
+    while ((supply = g_dir_read_name (dir)) != NULL) {
+        g_autofree gchar *type = read_attribute (supply, "type");
+        g_autofree gchar *online = NULL;
+
+        if (type == NULL || g_strcmp0 (type, "Battery") == 0)
+            continue;
+
+        online = read_attribute (supply, "online");
+        if (online != NULL && g_strcmp0 (online, "0") != 0)
+            return g_strdup (supply);
+    }
+
+    return NULL;
+}
+
+static gchar*
+get_usb_type (const gchar *supply) {
+    g_autofree gchar *usb_type = read_attribute (supply, "usb_type");
+    gchar *start;
+    gchar *end;
+
+    if (usb_type == NULL)
+        return NULL;
+
+    // Active type is between brackets: "Unknown SDP [DCP] CDP"
+    start = strchr (usb_type, '[');
+    end = start != NULL ? strchr (start, ']') : NULL;
+    if (end == NULL)
+        return NULL;
+
+    return g_strndup (start + 1, end - start - 1);
+}
+
+/**
+ * power_supply_get_charger_type:
+ *
+ * Get type of online charger from power_supply usb_type or type nodes.
+ *
+ * Returns: (transfer full): charger type, "Unknown" if not available
+ */
+gchar*
+power_supply_get_charger_type (void) {
+    g_autoptr(GDir) dir = NULL;
+    const gchar *supply;
+
+    dir = g_dir_open (power_supply_get_root (), 0, NULL);
+    if (dir == NULL)
+        return g_strdup ("Unknown");
+
+    while ((supply = g_dir_read_name (dir)) != NULL) {
+        g_autofree gchar *type = read_attribute (supply, "type");
+        g_autofree gchar *online = NULL;
+        gchar *usb_type;
+
+        if (type == NULL || g_strcmp0 (type, "Battery") == 0)
+            continue;
+
+        online = read_attribute (supply, "online");
+        if (g_strcmp0 (online, "1") != 0)
+            continue;
+
+        usb_type = get_usb_type (supply);
+        if (usb_type != NULL && g_strcmp0 (usb_type, "Unknown") != 0)
+            return usb_type;
+        g_free (usb_type);
+
+        return g_steal_pointer (&type);
+    }
+
+    return g_strdup ("Unknown");
+}
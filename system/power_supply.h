@@ -0,0 +1,26 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef POWER_SUPPLY_H
+#define POWER_SUPPLY_H
+
+#include <glib.h>
+
+#define POWER_SUPPLY_PATH "/sys/class/power_supply"
+
+G_BEGIN_DECLS
+
+void            power_supply_set_root         (const gchar *root);
+const gchar*    power_supply_get_root         (void);
+gchar*          power_supply_get_attribute    (const gchar *supply,
+                                               const gchar *attribute);
+gchar**         power_supply_get_batteries    (void);
+gchar*          power_supply_get_battery      (void);
+gboolean        power_supply_get_online       (gboolean *online);
+gchar*          power_supply_get_online_input (void);
+gchar*          power_supply_get_charger_type (void);
+
+G_END_DECLS
+
+#endif
@@ -2,18 +2,65 @@
  * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
  */
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <cjson/cJSON.h>
 
+#include "control_group.h"
+#include "power_supply.h"
 #include "settings.h"
 #include "config.h"
 
+/*
+ * Control classes, from most to least disruptive:
+ * - input: cuts charger input, device runs on battery
+ * - charge: stops charging, device runs on charger
+ * - threshold: hardware handles thresholds
+ */
+static const gchar *CONTROL_CLASSES[] = {
+    "input",
+    "charge",
+    "threshold",
+    NULL
+};
+
+#define CONTROL_PRIORITY_MAX 999
+#define POWER_SUPPLY_DIR     "/power_supply/"
+
+enum {
+    PROP_0,
+    PROP_BATTERY
+};
+
 struct _SettingsPrivate {
+    gchar *battery;
+
+    SettingsControlMode control_mode;
+    gint control_class;
+    gint control_rank;
+
     gchar* sysfs_suspend_input_path;
-    gint   sysfs_suspend_input_value;
-    gint   sysfs_resume_input_value;
+    ControlGroup *control_group;
+    GHashTable *routes;
+    ControlGroup *discharge_group;
+    gint discharge_rank;
+
+    gchar* sysfs_start_threshold_path;
+    gchar* sysfs_end_threshold_path;
+
+    gchar* sysfs_current_path;
+    gint   current_min;
+    gint   current_max;
 };
 
+typedef struct {
+    gint rank;
+    ControlGroup *control_group;
+} SettingsRoute;
+
+static gchar *settings_devices = NULL;
+
 G_DEFINE_TYPE_WITH_CODE (
     Settings,
     settings,
@@ -21,12 +68,25 @@ G_DEFINE_TYPE_WITH_CODE (
     G_ADD_PRIVATE (Settings)
 )
 
+static void
+settings_route_free (SettingsRoute *route) {
+    g_clear_object (&route->control_group);
+    g_free (route);
+}
+
 static void
 settings_dispose (GObject *settings)
 {
     Settings *self = SETTINGS (settings);
 
+    g_free (self->priv->battery);
     g_free (self->priv->sysfs_suspend_input_path);
+    g_clear_object (&self->priv->control_group);
+    g_clear_pointer (&self->priv->routes, g_hash_table_unref);
+    g_clear_object (&self->priv->discharge_group);
+    g_free (self->priv->sysfs_start_threshold_path);
+    g_free (self->priv->sysfs_end_threshold_path);
+    g_free (self->priv->sysfs_current_path);
 
     G_OBJECT_CLASS (settings_parent_class)->dispose (settings);
 }
@@ -37,32 +97,364 @@ settings_finalize (GObject *settings)
     G_OBJECT_CLASS (settings_parent_class)->finalize (settings);
 }
 
+static gboolean
+settings_is_value (cJSON *value) {
+    return cJSON_IsNumber (value) ||
+        (cJSON_IsString (value) && value->valuestring != NULL);
+}
+
+static gchar *
+settings_parse_value (cJSON *value) {
+    if (cJSON_IsNumber (value))
+        return g_strdup_printf ("%d", value->valueint);
+    if (cJSON_IsString (value) && value->valuestring != NULL)
+        return g_strdup (value->valuestring);
+    return NULL;
+}
+
+static gint
+settings_parse_class (cJSON *device) {
+    cJSON *class = cJSON_GetObjectItem (device, "class");
+    gint i;
+
+    if (cJSON_IsString (class) && class->valuestring != NULL) {
+        for (i = 0; CONTROL_CLASSES[i] != NULL; i++) {
+            if (g_strcmp0 (class->valuestring, CONTROL_CLASSES[i]) == 0)
+                return i;
+        }
+    }
+    // Unknown, assume the most disruptive
+    return 0;
+}
+
+/*
+ * power_supply entry in node path
+ */
+static gchar *
+settings_parse_supply (cJSON *device) {
+    const gchar *keys[] = { "path", "end_path", "start_path", NULL };
+    gint i;
+
+    for (i = 0; keys[i] != NULL; i++) {
+        cJSON *path = cJSON_GetObjectItem (device, keys[i]);
+        const gchar *supply;
+        const gchar *end;
+
+        if (!cJSON_IsString (path) || path->valuestring == NULL)
+            continue;
+
+        supply = strstr (path->valuestring, POWER_SUPPLY_DIR);
+        if (supply == NULL)
+            continue;
+
+        supply += strlen (POWER_SUPPLY_DIR);
+        end = strchr (supply, '/');
+        if (end == NULL)
+            continue;
+
+        return g_strndup (supply, end - supply);
+    }
+
+    return NULL;
+}
+
+/*
+ * Battery a node belongs to: explicit "battery" key, else power_supply
+ * entry in node path. NULL for nodes shared by all batteries.
+ */
+static gchar *
+settings_parse_battery (cJSON *device) {
+    cJSON *battery = cJSON_GetObjectItem (device, "battery");
+    cJSON *group = cJSON_GetObjectItem (device, "group");
+
+    if (cJSON_IsString (battery) && battery->valuestring != NULL)
+        return g_strdup (battery->valuestring);
+
+    if (cJSON_IsArray (group) && cJSON_GetArraySize (group) > 0)
+        return settings_parse_battery (cJSON_GetArrayItem (group, 0));
+
+    return settings_parse_supply (device);
+}
+
+/*
+ * Charger input a node controls: explicit "input" key, else a non
+ * battery power_supply entry in node path. NULL for battery nodes.
+ */
+static gchar *
+settings_parse_input (cJSON *node) {
+    cJSON *input = cJSON_GetObjectItem (node, "input");
+    g_autofree gchar *supply = NULL;
+    g_autofree gchar *type = NULL;
+
+    if (cJSON_IsString (input) && input->valuestring != NULL)
+        return g_strdup (input->valuestring);
+
+    supply = settings_parse_supply (node);
+    if (supply == NULL)
+        return NULL;
+
+    type = power_supply_get_attribute (supply, "type");
+    if (type == NULL || g_strcmp0 (type, "Battery") == 0)
+        return NULL;
+
+    return g_steal_pointer (&supply);
+}
+
+/*
+ * Without a battery, all nodes match. With a battery, only its own
+ * nodes match: shared nodes can't be driven by per-battery loops.
+ */
+static gboolean
+settings_match (Settings *self,
+                cJSON    *device) {
+    g_autofree gchar *battery = NULL;
+
+    if (self->priv->battery == NULL)
+        return TRUE;
+
+    battery = settings_parse_battery (device);
+    return g_strcmp0 (battery, self->priv->battery) == 0;
+}
+
+static gint
+settings_parse_rank (cJSON *device) {
+    cJSON *priority = cJSON_GetObjectItem (device, "priority");
+    gint rank = settings_parse_class (device) * (CONTROL_PRIORITY_MAX + 1);
+
+    if (cJSON_IsNumber (priority))
+        rank += CLAMP (priority->valueint, 0, CONTROL_PRIORITY_MAX);
+
+    return rank;
+}
+
+/*
+ * Least disruptive node wins, on equal rank last one wins
+ */
+static gboolean
+settings_select (Settings *self,
+                 cJSON    *device) {
+    gint rank = settings_parse_rank (device);
+
+    if (!settings_match (self, device))
+        return FALSE;
+
+    if (rank < self->priv->control_rank)
+        return FALSE;
+
+    self->priv->control_rank = rank;
+    self->priv->control_class = settings_parse_class (device);
+    return TRUE;
+}
+
+static gboolean
+settings_parse_thresholds (Settings *self,
+                           cJSON    *device) {
+    cJSON *mode = cJSON_GetObjectItem (device, "mode");
+    cJSON *start_path = cJSON_GetObjectItem (device, "start_path");
+    cJSON *end_path = cJSON_GetObjectItem (device, "end_path");
+
+    if (!cJSON_IsString (mode) ||
+            g_strcmp0 (mode->valuestring, "thresholds") != 0) {
+        return FALSE;
+    }
+    if (!cJSON_IsString (start_path) || (start_path->valuestring == NULL)) {
+        return TRUE;
+    }
+    if (!cJSON_IsString (end_path) || (end_path->valuestring == NULL)) {
+        return TRUE;
+    }
+    if (g_file_test (start_path->valuestring, G_FILE_TEST_EXISTS) &&
+            g_file_test (end_path->valuestring, G_FILE_TEST_EXISTS) &&
+            settings_select (self, device)) {
+        self->priv->control_mode = SETTINGS_CONTROL_MODE_THRESHOLDS;
+        g_free (self->priv->sysfs_start_threshold_path);
+        g_free (self->priv->sysfs_end_threshold_path);
+        self->priv->sysfs_start_threshold_path = g_strdup (
+            start_path->valuestring
+        );
+        self->priv->sysfs_end_threshold_path = g_strdup (
+            end_path->valuestring
+        );
+    }
+    return TRUE;
+}
+
+static gboolean
+settings_parse_current (Settings *self,
+                        cJSON    *device) {
+    cJSON *mode = cJSON_GetObjectItem (device, "mode");
+    cJSON *path = cJSON_GetObjectItem (device, "path");
+    cJSON *min = cJSON_GetObjectItem (device, "min");
+    cJSON *max = cJSON_GetObjectItem (device, "max");
+
+    if (!cJSON_IsString (mode) ||
+            g_strcmp0 (mode->valuestring, "current") != 0) {
+        return FALSE;
+    }
+    if (!cJSON_IsString (path) || (path->valuestring == NULL)) {
+        return TRUE;
+    }
+    if (!cJSON_IsNumber (min) || !cJSON_IsNumber (max) ||
+            min->valueint <= 0 || min->valueint >= max->valueint) {
+        return TRUE;
+    }
+    if (g_file_test (path->valuestring, G_FILE_TEST_EXISTS) &&
+            settings_match (self, device)) {
+        g_free (self->priv->sysfs_current_path);
+        self->priv->sysfs_current_path = g_strdup (path->valuestring);
+        self->priv->current_min = min->valueint;
+        self->priv->current_max = max->valueint;
+    }
+    return TRUE;
+}
+
+static gboolean
+settings_add_node (ControlGroup *control_group,
+                   cJSON        *node) {
+    cJSON *path = cJSON_GetObjectItem (node, "path");
+    cJSON *suspend = cJSON_GetObjectItem (node, "suspend");
+    cJSON *resume = cJSON_GetObjectItem (node, "resume");
+    cJSON *discharge = cJSON_GetObjectItem (node, "discharge");
+    g_autofree gchar *suspend_value = NULL;
+    g_autofree gchar *resume_value = NULL;
+    g_autofree gchar *discharge_value = NULL;
+
+    if (!cJSON_IsString (path) || (path->valuestring == NULL)) {
+        return FALSE;
+    }
+    if (!settings_is_value (suspend)) {
+        return FALSE;
+    }
+    if (!settings_is_value (resume)) {
+        return FALSE;
+    }
+    if (!g_file_test (path->valuestring, G_FILE_TEST_EXISTS)) {
+        return FALSE;
+    }
+
+    // -1: node is an end threshold, suspend writes start threshold
+    if (!cJSON_IsNumber (suspend) || suspend->valueint != -1)
+        suspend_value = settings_parse_value (suspend);
+    resume_value = settings_parse_value (resume);
+    discharge_value = settings_parse_value (discharge);
+
+    control_group_add_node (
+        control_group,
+        path->valuestring,
+        resume_value,
+        suspend_value,
+        discharge_value
+    );
+    return TRUE;
+}
+
+/*
+ * A device entry is a single node or an ordered "group" of nodes,
+ * all nodes must be available.
+ */
+static ControlGroup *
+settings_parse_group (cJSON *device) {
+    cJSON *group = cJSON_GetObjectItem (device, "group");
+    ControlGroup *control_group = CONTROL_GROUP (control_group_new ());
+    gint size, i;
+
+    if (!cJSON_IsArray (group)) {
+        if (!settings_add_node (control_group, device))
+            g_clear_object (&control_group);
+        return control_group;
+    }
+
+    size = cJSON_GetArraySize (group);
+    for (i = 0; i < size; i++) {
+        cJSON *node = cJSON_GetArrayItem (group, i);
+
+        if (!settings_add_node (control_group, node)) {
+            g_clear_object (&control_group);
+            return NULL;
+        }
+    }
+
+    if (size == 0)
+        g_clear_object (&control_group);
+
+    return control_group;
+}
+
+/*
+ * Route each input node of an entry to its charger input, best ranked
+ * entry wins as for settings_select().
+ */
 static void
-settings_class_init (SettingsClass *klass)
-{
-    GObjectClass *object_class;
+settings_parse_routes (Settings *self,
+                       cJSON    *device) {
+    cJSON *group = cJSON_GetObjectItem (device, "group");
+    gint rank = settings_parse_rank (device);
+    gint size, i;
 
-    object_class = G_OBJECT_CLASS (klass);
-    object_class->dispose = settings_dispose;
-    object_class->finalize = settings_finalize;
+    if (settings_parse_class (device) != 0 || !settings_match (self, device))
+        return;
+
+    size = cJSON_IsArray (group) ? cJSON_GetArraySize (group) : 1;
+    for (i = 0; i < size; i++) {
+        cJSON *node = cJSON_IsArray (group) ?
+            cJSON_GetArrayItem (group, i) : device;
+        g_autofree gchar *input = settings_parse_input (node);
+        SettingsRoute *route;
+
+        if (input == NULL)
+            continue;
+
+        route = g_hash_table_lookup (self->priv->routes, input);
+        if (route != NULL && route->rank > rank)
+            continue;
+
+        route = g_new0 (SettingsRoute, 1);
+        route->rank = rank;
+        route->control_group = CONTROL_GROUP (control_group_new ());
+        if (!settings_add_node (route->control_group, node)) {
+            settings_route_free (route);
+            continue;
+        }
+
+        g_hash_table_replace (
+            self->priv->routes, g_steal_pointer (&input), route
+        );
+    }
 }
 
+/*
+ * Best ranked nodes able to drain battery, usable along hardware
+ * thresholds whatever the selected class
+ */
 static void
-settings_init (Settings *self)
+settings_parse_discharge (Settings     *self,
+                          cJSON        *device,
+                          ControlGroup *control_group) {
+    gint rank = settings_parse_rank (device);
+
+    if (!control_group_can_discharge (control_group) ||
+            !settings_match (self, device) ||
+            rank < self->priv->discharge_rank)
+        return;
+
+    g_clear_object (&self->priv->discharge_group);
+    self->priv->discharge_group = g_object_ref (control_group);
+    self->priv->discharge_rank = rank;
+}
+
+static void
+settings_load (Settings *self)
 {
     cJSON *root = NULL;
     cJSON *device = NULL;
-    cJSON *path = NULL;
-    cJSON *suspend = NULL;
-    cJSON *resume = NULL;
-    GFile *devices_json = g_file_new_for_path (DEVICES_JSON);
+    ControlGroup *control_group = NULL;
+    GFile *devices_json = g_file_new_for_path (
+        settings_devices != NULL ? settings_devices : DEVICES_JSON
+    );
     GError *error = NULL;
 	gchar *content = NULL;
     gint size, i;
 
-    self->priv = settings_get_instance_private (self);
-    self->priv->sysfs_suspend_input_path = NULL;
-
     if (!g_file_query_exists (devices_json, NULL)) {
         g_error("Devices json file missing");
         goto end;
@@ -91,30 +483,167 @@ settings_init (Settings *self)
     
     for (i = 0; i < size; i++) {
         device = cJSON_GetArrayItem (root, i);
-        path = cJSON_GetObjectItem (device, "path");
-        suspend = cJSON_GetObjectItem (device, "suspend");
-        resume = cJSON_GetObjectItem (device, "resume");
 
-        if (!cJSON_IsString (path) || (path->valuestring == NULL)) {
+        if (settings_parse_thresholds (self, device)) {
             continue;
         }
-        if (!cJSON_IsNumber (suspend)) {
+        if (settings_parse_current (self, device)) {
             continue;
         }
-        if (!cJSON_IsNumber (resume)) {
+
+        control_group = settings_parse_group (device);
+        if (control_group == NULL) {
             continue;
         }
-        if (g_file_test (path->valuestring, G_FILE_TEST_EXISTS)) {
-            self->priv->sysfs_suspend_input_path = g_strdup(path->valuestring);
-            self->priv->sysfs_suspend_input_value = suspend->valueint;
-            self->priv->sysfs_resume_input_value = resume->valueint;
+        settings_parse_routes (self, device);
+        settings_parse_discharge (self, device, control_group);
+        if (settings_select (self, device)) {
+            self->priv->control_mode = SETTINGS_CONTROL_MODE_INPUT;
+            g_free (self->priv->sysfs_suspend_input_path);
+            g_clear_object (&self->priv->control_group);
+            self->priv->sysfs_suspend_input_path = g_strdup (
+                control_group_get_path (control_group, 0)
+            );
+            self->priv->control_group = control_group;
+        } else {
+            g_object_unref (control_group);
         }
     }
     
 error:
     cJSON_Delete (root);
 end:
-    g_message("Detected input sysfs node: %s", self->priv->sysfs_suspend_input_path);
+    if (self->priv->battery != NULL)
+        g_message ("Battery: %s", self->priv->battery);
+
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS)
+        g_message(
+            "Detected threshold sysfs nodes: %s %s (%s)",
+            self->priv->sysfs_start_threshold_path,
+            self->priv->sysfs_end_threshold_path,
+            settings_get_control_class (self)
+        );
+    else if (self->priv->control_group != NULL)
+        g_message(
+            "Detected input sysfs node: %s (%s, %u nodes)",
+            self->priv->sysfs_suspend_input_path,
+            settings_get_control_class (self),
+            control_group_get_length (self->priv->control_group)
+        );
+
+    // Only input nodes can be routed, other classes act on the battery
+    if (self->priv->control_class != 0 ||
+            self->priv->control_mode != SETTINGS_CONTROL_MODE_INPUT)
+        g_hash_table_remove_all (self->priv->routes);
+    else if (g_hash_table_size (self->priv->routes) > 0)
+        g_message(
+            "Detected %u routed charger inputs",
+            g_hash_table_size (self->priv->routes)
+        );
+
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS &&
+            self->priv->discharge_group != NULL)
+        g_message(
+            "Detected discharge sysfs node: %s",
+            control_group_get_path (self->priv->discharge_group, 0)
+        );
+
+    if (self->priv->sysfs_current_path != NULL)
+        g_message(
+            "Detected current sysfs node: %s (%d-%d)",
+            self->priv->sysfs_current_path,
+            self->priv->current_min,
+            self->priv->current_max
+        );
+}
+
+static void
+settings_set_property (GObject *object,
+                       guint property_id,
+                       const GValue *value,
+                       GParamSpec *pspec)
+{
+    Settings *self = SETTINGS (object);
+
+    switch (property_id) {
+        case PROP_BATTERY:
+            self->priv->battery = g_value_dup_string (value);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+settings_constructed (GObject *settings)
+{
+    Settings *self = SETTINGS (settings);
+
+    G_OBJECT_CLASS (settings_parent_class)->constructed (settings);
+
+    settings_load (self);
+}
+
+static void
+settings_class_init (SettingsClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->constructed = settings_constructed;
+    object_class->dispose = settings_dispose;
+    object_class->finalize = settings_finalize;
+    object_class->set_property = settings_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_BATTERY,
+        g_param_spec_string (
+            "battery",
+            "Battery",
+            "Only use nodes of this battery, all nodes if NULL",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+}
+
+static void
+settings_init (Settings *self)
+{
+    self->priv = settings_get_instance_private (self);
+    self->priv->battery = NULL;
+    self->priv->control_mode = SETTINGS_CONTROL_MODE_INPUT;
+    self->priv->control_class = 0;
+    self->priv->control_rank = -1;
+    self->priv->sysfs_suspend_input_path = NULL;
+    self->priv->control_group = NULL;
+    self->priv->routes = g_hash_table_new_full (
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify) settings_route_free
+    );
+    self->priv->discharge_group = NULL;
+    self->priv->discharge_rank = -1;
+    self->priv->sysfs_start_threshold_path = NULL;
+    self->priv->sysfs_end_threshold_path = NULL;
+    self->priv->sysfs_current_path = NULL;
+    self->priv->current_min = 0;
+    self->priv->current_max = 0;
+}
+
+/**
+ * settings_set_devices:
+ *
+ * Read control nodes from another devices json file, used to run
+ * against a fake sysfs tree.
+ *
+ * @filename: (nullable): devices json file, default if NULL
+ */
+void
+settings_set_devices (const gchar *filename) {
+    g_free (settings_devices);
+    settings_devices = g_strdup (filename);
 }
 
 /**
@@ -122,53 +651,175 @@ end:
  *
  * Creates a new #Settings
  *
+ * @battery: (nullable): only use nodes of this battery
+ *
  * Returns: (transfer full): a new #Settings
  *
  **/
 GObject *
-settings_new (void)
+settings_new (const gchar *battery)
 {
     GObject *settings;
 
-    settings = g_object_new (TYPE_SETTINGS, NULL);
+    settings = g_object_new (TYPE_SETTINGS, "battery", battery, NULL);
 
     return settings;
 }
 
 /**
- * settings_get_input_suspend_sysfs_node:
- * 
- * Get sysfs node we need to write to suspend input
- * 
- * Returns: (transfer full): path to node
+ * settings_get_battery:
+ *
+ * Get battery nodes are restricted to
+ *
+ * Returns: (transfer none) (nullable): battery name, NULL for all
+ */
+const gchar*
+settings_get_battery (Settings *settings) {
+    return settings->priv->battery;
+}
+
+/**
+ * settings_has_control:
+ *
+ * Check if a control node was found
+ *
+ * Returns: TRUE if a control node is available
+ */
+gboolean
+settings_has_control (Settings *settings) {
+    return settings->priv->control_rank >= 0;
+}
+
+/**
+ * settings_has_routes:
+ *
+ * Check if input nodes are routed to their charger
+ *
+ * Returns: TRUE if a charger input is routed
+ */
+gboolean
+settings_has_routes (Settings *settings) {
+    return g_hash_table_size (settings->priv->routes) > 0;
+}
+
+/**
+ * settings_get_discharge_group:
+ *
+ * Get nodes able to drain battery, used along hardware thresholds
+ *
+ * Returns: (transfer none) (nullable): a #ControlGroup
+ */
+ControlGroup*
+settings_get_discharge_group (Settings *settings) {
+    return settings->priv->discharge_group;
+}
+
+/**
+ * settings_get_input_control_group:
+ *
+ * Get nodes we need to write to suspend or resume a charger input,
+ * falls back to default nodes if input is not routed
+ *
+ * @input: (nullable): online charger power supply name
+ *
+ * Returns: (transfer none) (nullable): a #ControlGroup
+ */
+ControlGroup*
+settings_get_input_control_group (Settings    *settings,
+                                  const gchar *input) {
+    SettingsRoute *route = NULL;
+
+    if (input != NULL)
+        route = g_hash_table_lookup (settings->priv->routes, input);
+
+    if (route != NULL)
+        return route->control_group;
+
+    return settings->priv->control_group;
+}
+
+/**
+ * settings_get_control_mode:
+ *
+ * Get how charging is controlled on this device
+ *
+ * Returns: a #SettingsControlMode
+ */
+SettingsControlMode
+settings_get_control_mode (Settings *settings) {
+    return settings->priv->control_mode;
+}
+
+/**
+ * settings_get_control_class:
+ *
+ * Get class of active control node: "input", "charge" or "threshold"
+ *
+ * Returns: (transfer none): class name
+ */
+const gchar*
+settings_get_control_class (Settings *settings) {
+    return CONTROL_CLASSES[settings->priv->control_class];
+}
+
+/**
+ * settings_get_sysfs_start_threshold_path:
+ *
+ * Get sysfs node of hardware start threshold
+ *
+ * Returns: (transfer none): path to node
  */
 gchar*
-settings_get_sysfs_suspend_input_path (Settings *settings) {
-    return settings->priv->sysfs_suspend_input_path;
+settings_get_sysfs_start_threshold_path (Settings *settings) {
+    return settings->priv->sysfs_start_threshold_path;
 }
 
 /**
- * settings_get_sysfs_suspend_input_value:
- * 
- * Get sysfs node value we need to write to suspend input
- * 
- * Returns: (transfer full): node value for suspend
+ * settings_get_sysfs_end_threshold_path:
+ *
+ * Get sysfs node of hardware end threshold
+ *
+ * Returns: (transfer none): path to node
+ */
+gchar*
+settings_get_sysfs_end_threshold_path (Settings *settings) {
+    return settings->priv->sysfs_end_threshold_path;
+}
+
+/**
+ * settings_get_sysfs_current_path:
+ *
+ * Get sysfs node limiting charge current, may be NULL
+ *
+ * Returns: (transfer none): path to node
+ */
+gchar*
+settings_get_sysfs_current_path (Settings *settings) {
+    return settings->priv->sysfs_current_path;
+}
+
+/**
+ * settings_get_current_min:
+ *
+ * Get lowest charge current limit, in µA
+ *
+ * Returns: current
  */
 gint
-settings_get_sysfs_suspend_input_value (Settings *settings) {
-    return settings->priv->sysfs_suspend_input_value;
+settings_get_current_min (Settings *settings) {
+    return settings->priv->current_min;
 }
 
 /**
- * settings_get_sysfs_resume_input_value:
- * 
- * Get sysfs node value we need to write to resume input
- * 
- * Returns: (transfer full): node value for resume
+ * settings_get_current_max:
+ *
+ * Get highest charge current limit, in µA
+ *
+ * Returns: current
  */
 gint
-settings_get_sysfs_resume_input_value (Settings *settings) {
-    return settings->priv->sysfs_resume_input_value;
+settings_get_current_max (Settings *settings) {
+    return settings->priv->current_max;
 }
 
 static Settings *default_settings = NULL;
@@ -183,7 +834,7 @@ Settings *
 settings_get_default (void)
 {
     if (!default_settings) {
-        default_settings = SETTINGS (settings_new ());
+        default_settings = SETTINGS (settings_new (NULL));
     }
     return g_object_ref (default_settings);
 }
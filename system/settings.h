@@ -8,6 +8,8 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "control_group.h"
+
 #define TYPE_SETTINGS \
     (settings_get_type ())
 #define SETTINGS(obj) \
@@ -28,6 +30,11 @@
 
 G_BEGIN_DECLS
 
+typedef enum {
+    SETTINGS_CONTROL_MODE_INPUT,
+    SETTINGS_CONTROL_MODE_THRESHOLDS
+} SettingsControlMode;
+
 typedef struct _Settings Settings;
 typedef struct _SettingsClass SettingsClass;
 typedef struct _SettingsPrivate SettingsPrivate;
@@ -43,10 +50,22 @@ struct _SettingsClass {
 
 GType           settings_get_type                      (void) G_GNUC_CONST;
 Settings       *settings_get_default                   (void);
-GObject*        settings_new                           (void);
-gchar*          settings_get_sysfs_suspend_input_path  (Settings *settings);
-gint            settings_get_sysfs_suspend_input_value (Settings *settings);
-gint            settings_get_sysfs_resume_input_value  (Settings *settings);
+GObject*        settings_new                           (const gchar *battery);
+void            settings_set_devices                   (const gchar *filename);
+const gchar*    settings_get_battery                   (Settings *settings);
+gboolean        settings_has_control                   (Settings *settings);
+ControlGroup*   settings_get_input_control_group       (Settings *settings,
+                                                        const gchar *input);
+gboolean        settings_has_routes                    (Settings *settings);
+ControlGroup*   settings_get_discharge_group           (Settings *settings);
+SettingsControlMode
+                settings_get_control_mode              (Settings *settings);
+const gchar*    settings_get_control_class             (Settings *settings);
+gchar*          settings_get_sysfs_start_threshold_path (Settings *settings);
+gchar*          settings_get_sysfs_end_threshold_path  (Settings *settings);
+gchar*          settings_get_sysfs_current_path        (Settings *settings);
+gint            settings_get_current_min               (Settings *settings);
+gint            settings_get_current_max               (Settings *settings);
 G_END_DECLS
 
 #endif
@@ -4,55 +4,122 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include <gio/gio.h>
 
+#include "config.h"
+#include "battery_source.h"
+#include "charge_curve.h"
+#include "charge_model.h"
+#include "control_node.h"
 #include "d-bus.h"
+#include "habits.h"
+#include "power_supply.h"
 #include "settings.h"
 #include "suspend.h"
-
-#define UPOWER_DBUS_NAME       "org.freedesktop.UPower"
-#define UPOWER_DBUS_PATH       "/org/freedesktop/UPower/devices/DisplayDevice"
-#define UPOWER_DBUS_INTERFACE  "org.freedesktop.UPower.Device"
+#include "timer_wheel.h"
+#include "wake_alarm.h"
 
 #define INPUT_THRESHOLD_START  60
 #define INPUT_THRESHOLD_END    80
 #define INPUT_THRESHOLD_MAX    100
 
-#define REFRESH_RATE_START     10000
-#define REFRESH_RATE           300000
-#define REFRESH_RATE_SIMULATE  10000
+#define INPUT_HYSTERESIS       2
+#define INPUT_DWELL_TIME       120
+#define INPUT_TOGGLES_PER_HOUR 6
+#define INPUT_TOGGLES_HISTORY  32
+// Delay before writing nodes again after a failure
+#define INPUT_RETRY_DELAY      60
+// Delay for a resumed charger to show up online again
+#define INPUT_ONLINE_DELAY     5
 
-#define TIME_TO_FULL_DELTA     1800
 #define MIN_TIME_TO_FULL       1000
-
-#define SIMULATE_CYCLE_START   79
+#define ALARM_LEAD_TIME        300
+
+#define CHARGE_CURVES_FILE     "charge-curves.bin"
+#define HABITS_FILE            "habits.bin"
+#define INPUT_STATE_FILE       "input-state.ini"
+#define INPUT_STATE_GROUP      "Input"
+// Shorter charges are not habits
+#define HABITS_MIN_PLUGGED     1800
+
+#define CURRENT_TAPER_RANGE    10
+#define CURRENT_TAPER_STEPS    4
+
+// Input state file values, indexed by ControlGroupState
+static const gchar *INPUT_STATES[CONTROL_GROUP_LAST] = {
+    "resume",
+    "suspend",
+    "discharge"
+};
 
 enum {
     PROP_0,
+    PROP_SOURCE,
+    PROP_SETTINGS,
     PROP_SIMULATE
 };
 
 struct _SuspendPrivate {
-    GDBusProxy *upower_proxy;
+    BatterySource *source;
+    Settings *settings;
+    ChargeModel *charge_model;
+    ChargeCurve *charge_curve;
+    Habits *habits;
 
     gint threshold_max;
     gint threshold_start;
     gint threshold_end;
 
+    gint hysteresis;
+    gint dwell_time;
+    gint toggles_per_hour;
+
+    gint64 toggles[INPUT_TOGGLES_HISTORY];
+    guint toggles_index;
+    gint64 toggle_retry;
+    guint suppressed_dwell;
+    guint suppressed_budget;
+    guint suppressed_hysteresis;
+    ControlGroupState hysteresis_state;
+
     gint64 next_alarm;
-    gint64 time_to_full;
-    gint64 previous_time_to_full;
+    gint64 plugged_timestamp;
+    gint64 start_time;
+
+    gdouble percentage;
+    gdouble previous_percentage;
 
-    gint percentage;
-    gint previous_percentage;
+    gdouble energy;
+    gdouble energy_full;
+    gdouble energy_rate;
 
     guint handle_timeout_id;
+    guint update_idle_id;
+    guint online_timeout_id;
+    guint timer_wakeups;
 
     gboolean suspended;
+    gboolean discharging;
+    gboolean input_pending;
+    gboolean input_dropped;
+    gboolean control_dropped;
+    ControlGroupState input_request;
+    const gchar *input_reason;
+    gint input_fallback;
     gboolean suspend_lock;
+    gboolean plugged;
 
     gboolean simulate;
+
+    SettingsControlMode control_mode;
+    ControlGroup *control_group;
+    ControlGroup *previous_group;
+    gchar *control_input;
+    gint programmed_start;
+    gint programmed_end;
+    gint current_limit;
 };
 
 G_DEFINE_TYPE_WITH_CODE (
@@ -62,306 +129,1373 @@ G_DEFINE_TYPE_WITH_CODE (
     G_ADD_PRIVATE (Suspend)
 )
 
+static gint64
+get_current_timestamp (void) {
+    return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+/*
+ * Per battery loops prefix their statistics with battery name
+ */
+static void
+set_statistic (Suspend     *self,
+               const gchar *key,
+               GVariant    *value) {
+    const gchar *battery = settings_get_battery (self->priv->settings);
+    g_autofree gchar *battery_key = NULL;
+
+    if (battery != NULL)
+        battery_key = g_strdup_printf ("%s/%s", battery, key);
+
+    bim_bus_set_statistic (
+        bim_bus_get_default (),
+        battery_key != NULL ? battery_key : key,
+        value
+    );
+}
+
+/*
+ * Per battery loops keep their own learnt state
+ */
+static gchar *
+get_state_filename (Suspend     *self,
+                    const gchar *filename) {
+    const gchar *battery = settings_get_battery (self->priv->settings);
+    g_autofree gchar *battery_filename = NULL;
+
+    if (battery == NULL)
+        return g_build_filename (STATE_DIR, filename, NULL);
+
+    battery_filename = g_strdup_printf ("%s-%s", battery, filename);
+    return g_build_filename (STATE_DIR, battery_filename, NULL);
+}
+
 static void
-suspend_input (Suspend *self) {
-    Settings *settings = settings_get_default ();
-    FILE *sysfs;
-    gint suspend_value;
+update_controller_statistics (Suspend *self) {
+    set_statistic (
+        self,
+        "suppressed-dwell",
+        g_variant_new_uint32 (self->priv->suppressed_dwell)
+    );
+    set_statistic (
+        self,
+        "suppressed-budget",
+        g_variant_new_uint32 (self->priv->suppressed_budget)
+    );
+    set_statistic (
+        self,
+        "suppressed-hysteresis",
+        g_variant_new_uint32 (self->priv->suppressed_hysteresis)
+    );
+}
+
+static gint64
+get_next_alarm (Suspend *self) {
+    gint64 next_alarm = bim_bus_get_next_alarm (bim_bus_get_default ());
+    gint64 next_unplug = habits_get_next_unplug (
+        self->priv->habits, get_current_timestamp ()
+    );
 
-    sysfs = fopen(
-        settings_get_sysfs_suspend_input_path (settings),
-        "w"
+    set_statistic (
+        self,
+        "predicted-unplug",
+        g_variant_new_int64 (next_unplug)
     );
 
-    g_return_if_fail (sysfs != NULL);
+    // Handle predicted unplug as an alarm
+    if (next_unplug != 0 && (next_alarm == 0 || next_unplug < next_alarm)) {
+        g_message ("Predicted unplug: %ld", (long) next_unplug);
+        return next_unplug;
+    }
+
+    return next_alarm;
+}
+
+static gint64 get_alarm_deadline (Suspend *self);
+
+static gboolean
+can_toggle_input (Suspend *self) {
+    gint64 timestamp = get_current_timestamp ();
+    gint64 last_toggle;
+    gint64 oldest_toggle;
+
+    last_toggle = self->priv->toggles[
+        (self->priv->toggles_index + INPUT_TOGGLES_HISTORY - 1) %
+            INPUT_TOGGLES_HISTORY
+    ];
+    // Toggle that will leave the one hour window once budget is exhausted
+    oldest_toggle = self->priv->toggles[
+        (self->priv->toggles_index + INPUT_TOGGLES_HISTORY -
+            self->priv->toggles_per_hour) % INPUT_TOGGLES_HISTORY
+    ];
+
+    if (last_toggle != 0 &&
+            timestamp < last_toggle + self->priv->dwell_time) {
+        g_message ("Input toggle suppressed: dwell time");
+        self->priv->toggle_retry = last_toggle + self->priv->dwell_time;
+        self->priv->suppressed_dwell += 1;
+        update_controller_statistics (self);
+        return FALSE;
+    }
+
+    if (oldest_toggle != 0 && timestamp < oldest_toggle + 3600) {
+        g_message ("Input toggle suppressed: hourly budget");
+        self->priv->toggle_retry = oldest_toggle + 3600;
+        self->priv->suppressed_budget += 1;
+        update_controller_statistics (self);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Only applied toggles count for dwell time and hourly budget
+ */
+static void
+add_toggle (Suspend *self,
+            gint64   timestamp) {
+    self->priv->toggles[self->priv->toggles_index] = timestamp;
+    self->priv->toggles_index = (self->priv->toggles_index + 1) %
+        INPUT_TOGGLES_HISTORY;
+}
+
+static gint
+read_sysfs_value (const gchar *path) {
+    g_autofree gchar *content = control_node_read (control_node_get (path));
+
+    if (content == NULL)
+        return -1;
 
-    suspend_value = settings_get_sysfs_suspend_input_value (settings);
+    return (gint) g_ascii_strtoll (content, NULL, 10);
+}
+
+static void
+write_sysfs_string (const gchar         *path,
+                    const gchar         *value,
+                    ControlNodeCallback  callback,
+                    gpointer             user_data) {
+    control_node_write (control_node_get (path), value, callback, user_data);
+}
 
+static void
+write_sysfs_value (const gchar         *path,
+                   gint                 value,
+                   ControlNodeCallback  callback,
+                   gpointer             user_data) {
+    gchar buffer[16];
+
+    g_snprintf (buffer, sizeof (buffer), "%d", value);
+
+    write_sysfs_string (path, buffer, callback, user_data);
+}
+
+/*
+ * Input class nodes cut the charger while suspended
+ */
+static gboolean
+input_is_cut (Suspend *self) {
+    return self->priv->control_mode == SETTINGS_CONTROL_MODE_INPUT &&
+        g_strcmp0 (
+            settings_get_control_class (self->priv->settings), "input"
+        ) == 0;
+}
+
+static gboolean check_online (Suspend *self);
+
+static void
+input_suspended (Suspend *self) {
     g_message ("Suspending input");
     bim_bus_input_suspended (
         bim_bus_get_default (),
         TRUE,
-        self->priv->next_alarm - self->priv->time_to_full
+        get_alarm_deadline (self)
     );
 
     self->priv->suspended = TRUE;
-    self->priv->previous_time_to_full = 0;
-    if (suspend_value == -1)
-        fprintf (sysfs, "%d", self->priv->threshold_start);
-    else
-        fprintf (sysfs, "%d", suspend_value);
-    fclose (sysfs);
+    self->priv->discharging = FALSE;
+    battery_source_set_charging (self->priv->source, FALSE);
+    charge_curve_save (self->priv->charge_curve);
 }
 
 static void
-resume_input (Suspend *self) {
-    Settings *settings = settings_get_default ();
-    FILE *sysfs;
+input_resumed (Suspend *self) {
+    g_message ("Resuming input");
+    bim_bus_input_suspended (bim_bus_get_default (), FALSE, 0);
 
-    sysfs = fopen(
-        settings_get_sysfs_suspend_input_path (settings),
-        "w"
+    self->priv->suspended = FALSE;
+    self->priv->discharging = FALSE;
+    battery_source_set_charging (self->priv->source, TRUE);
+    charge_model_reset (self->priv->charge_model);
+    charge_curve_reset (self->priv->charge_curve);
+
+    // Charger may have been unplugged while cut, online was not trusted
+    g_clear_handle_id (&self->priv->online_timeout_id, g_source_remove);
+    if (input_is_cut (self) && !self->priv->simulate)
+        self->priv->online_timeout_id = g_timeout_add_seconds (
+            INPUT_ONLINE_DELAY, (GSourceFunc) check_online, self
+        );
+}
+
+static void
+input_discharging (Suspend *self) {
+    g_message ("Discharging battery");
+    bim_bus_input_suspended (
+        bim_bus_get_default (),
+        TRUE,
+        get_alarm_deadline (self)
     );
 
-    g_return_if_fail (sysfs != NULL);
+    // Not charging, do not learn from samples
+    self->priv->suspended = TRUE;
+    self->priv->discharging = TRUE;
+    battery_source_set_charging (self->priv->source, FALSE);
+    charge_curve_save (self->priv->charge_curve);
+}
 
-    g_message ("Resuming input");
-    bim_bus_input_suspended (bim_bus_get_default (), FALSE, 0);
+/*
+ * Last decision survives restarts, see restore_input_state()
+ */
+static void
+save_input_state (Suspend *self) {
+    g_autoptr (GKeyFile) key_file = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autofree gchar *filename = NULL;
+    g_autofree gchar *dirname = NULL;
 
-    self->priv->suspended = FALSE;
-    fprintf (sysfs, "%d", settings_get_sysfs_resume_input_value (settings));
+    if (self->priv->simulate)
+        return;
 
-    fclose (sysfs);
+    key_file = g_key_file_new ();
+    g_key_file_set_string (
+        key_file,
+        INPUT_STATE_GROUP,
+        "State",
+        INPUT_STATES[self->priv->input_request]
+    );
+    g_key_file_set_int64 (
+        key_file, INPUT_STATE_GROUP, "Timestamp", get_current_timestamp ()
+    );
+    if (self->priv->input_reason != NULL)
+        g_key_file_set_string (
+            key_file, INPUT_STATE_GROUP, "Reason", self->priv->input_reason
+        );
+    // Written nodes and value, to read them back
+    if (self->priv->control_input != NULL)
+        g_key_file_set_string (
+            key_file, INPUT_STATE_GROUP, "Input", self->priv->control_input
+        );
+    g_key_file_set_integer (
+        key_file, INPUT_STATE_GROUP, "Fallback", self->priv->input_fallback
+    );
+
+    filename = get_state_filename (self, INPUT_STATE_FILE);
+    dirname = g_path_get_dirname (filename);
+    g_mkdir_with_parents (dirname, 0755);
+
+    if (!g_key_file_save_to_file (key_file, filename, &error))
+        g_warning ("Can't save input state: %s", error->message);
+}
+
+static void schedule_input (Suspend *self);
+static void update_input (Suspend *self);
+static void update_control_group (Suspend *self);
+
+/*
+ * Charger changes and decisions coming while nodes are written
+ */
+static void
+replay_dropped (Suspend  *self,
+                gboolean  dropped) {
+    if (self->priv->control_dropped && self->priv->plugged) {
+        self->priv->control_dropped = FALSE;
+        update_control_group (self);
+    }
+
+    if (dropped)
+        update_input (self);
+}
+
+static void
+on_input_applied (ControlGroup *control_group,
+                  gboolean      applied,
+                  gpointer      user_data) {
+    Suspend *self = SUSPEND (user_data);
+    gboolean dropped = self->priv->input_dropped;
+
+    self->priv->input_pending = FALSE;
+    self->priv->input_dropped = FALSE;
+
+    // Input state unchanged, decide again later
+    if (!applied) {
+        g_warning ("Can't change input state, retrying");
+        self->priv->toggle_retry = get_current_timestamp () +
+            INPUT_RETRY_DELAY;
+        schedule_input (self);
+        return;
+    }
+
+    add_toggle (self, get_current_timestamp ());
+
+    switch (self->priv->input_request) {
+        case CONTROL_GROUP_SUSPEND:
+            input_suspended (self);
+            break;
+        case CONTROL_GROUP_RESUME:
+            input_resumed (self);
+            break;
+        case CONTROL_GROUP_DISCHARGE:
+            input_discharging (self);
+            break;
+        case CONTROL_GROUP_LAST:
+        default:
+            break;
+    }
+
+    save_input_state (self);
+
+    replay_dropped (self, dropped);
+}
+
+/*
+ * Input state changes once nodes are written, one change at a time
+ */
+static void
+apply_input_state (Suspend           *self,
+                   ControlGroupState  state,
+                   const gchar       *reason) {
+    ControlGroup *control_group = self->priv->control_group;
+    gchar buffer[16];
+
+    if (control_group == NULL) {
+        g_warning ("No input control node");
+        return;
+    }
+
+    // End threshold nodes are suspended at start threshold
+    self->priv->input_fallback = self->priv->threshold_start;
+    g_snprintf (buffer, sizeof (buffer), "%d", self->priv->input_fallback);
+
+    self->priv->input_pending = TRUE;
+    self->priv->input_request = state;
+    self->priv->input_reason = reason;
+    control_group_apply (
+        control_group, state, buffer, on_input_applied, self
+    );
+}
+
+/*
+ * Safety stops and alarms are never delayed by dwell time and budget
+ */
+static void
+request_input_state (Suspend           *self,
+                     ControlGroupState  state,
+                     const gchar       *reason,
+                     gboolean           forced) {
+    if (self->priv->input_pending) {
+        self->priv->input_dropped = TRUE;
+        return;
+    }
+    if (!forced && !can_toggle_input (self))
+        return;
+
+    apply_input_state (self, state, reason);
+}
+
+static void
+suspend_input (Suspend     *self,
+               const gchar *reason) {
+    request_input_state (self, CONTROL_GROUP_SUSPEND, reason, FALSE);
+}
+
+static void
+resume_input (Suspend     *self,
+              const gchar *reason) {
+    request_input_state (self, CONTROL_GROUP_RESUME, reason, FALSE);
+}
+
+static void
+discharge_input (Suspend     *self,
+                 const gchar *reason) {
+    request_input_state (self, CONTROL_GROUP_DISCHARGE, reason, FALSE);
+}
+
+static void
+on_thresholds_written (ControlNode *control_node,
+                       gboolean     written,
+                       gpointer     user_data) {
+    Suspend *self = SUSPEND (user_data);
+
+    // Node state unknown, program both thresholds again on next update
+    if (!written) {
+        self->priv->programmed_start = -1;
+        self->priv->programmed_end = -1;
+    }
+}
+
+static void
+program_thresholds (Suspend *self,
+                    gint     start,
+                    gint     end) {
+    Settings *settings = self->priv->settings;
+    const gchar *start_path = settings_get_sysfs_start_threshold_path (
+        settings
+    );
+    const gchar *end_path = settings_get_sysfs_end_threshold_path (
+        settings
+    );
+
+    if (start == self->priv->programmed_start &&
+            end == self->priv->programmed_end)
+        return;
+
+    g_message ("Programming thresholds: %d %d", start, end);
+
+    // Drivers reject start >= end, order writes so it never happens
+    if (start < self->priv->programmed_end) {
+        write_sysfs_value (start_path, start, on_thresholds_written, self);
+        write_sysfs_value (end_path, end, on_thresholds_written, self);
+    } else {
+        write_sysfs_value (end_path, end, on_thresholds_written, self);
+        write_sysfs_value (start_path, start, on_thresholds_written, self);
+    }
+
+    self->priv->programmed_start = start;
+    self->priv->programmed_end = end;
+}
+
+/*
+ * Thresholds kept at least hysteresis apart
+ */
+static gint
+get_effective_start (Suspend *self) {
+    return MIN (
+        self->priv->threshold_start,
+        self->priv->threshold_end - self->priv->hysteresis
+    );
+}
+
+static gint
+get_effective_end (Suspend *self) {
+    return MAX (
+        self->priv->threshold_end,
+        self->priv->threshold_start + self->priv->hysteresis
+    );
+}
+
+/*
+ * Count suppressed transitions, not evaluations
+ */
+static void
+suppress_hysteresis (Suspend           *self,
+                     ControlGroupState  state) {
+    if (state != CONTROL_GROUP_LAST && state != self->priv->hysteresis_state) {
+        self->priv->suppressed_hysteresis += 1;
+        update_controller_statistics (self);
+    }
+    self->priv->hysteresis_state = state;
 }
 
 static gboolean
 handle_input_threshold_start (Suspend *self) {
-    if (self->priv->percentage <= self->priv->threshold_start) {
+    gint threshold_start = get_effective_start (self);
+
+    if (self->priv->percentage <= threshold_start) {
         g_message ("Reached start threshold");
-        resume_input (self);
+        suppress_hysteresis (self, CONTROL_GROUP_LAST);
+        resume_input (self, "start-threshold");
         return TRUE;
     }
+    if (self->priv->percentage <= self->priv->threshold_start)
+        suppress_hysteresis (self, CONTROL_GROUP_RESUME);
+    else
+        suppress_hysteresis (self, CONTROL_GROUP_LAST);
     return FALSE;
 }
 
 static gboolean
 handle_input_threshold_end (Suspend *self) {
-    if (self->priv->percentage >= self->priv->threshold_end) {
+    gint threshold_end = get_effective_end (self);
+
+    if (self->priv->percentage >= threshold_end) {
         g_message ("Reached end threshold");
-        suspend_input (self);
+        suppress_hysteresis (self, CONTROL_GROUP_LAST);
+        suspend_input (self, "end-threshold");
+        return TRUE;
+    }
+    if (self->priv->percentage >= self->priv->threshold_end)
+        suppress_hysteresis (self, CONTROL_GROUP_SUSPEND);
+    else
+        suppress_hysteresis (self, CONTROL_GROUP_LAST);
+    return FALSE;
+}
+
+static gboolean
+handle_input_threshold_max (Suspend *self) {
+    if (self->priv->percentage >= self->priv->threshold_max) {
+        g_message ("Reached max threshold");
+        request_input_state (
+            self, CONTROL_GROUP_SUSPEND, "max-threshold", TRUE
+        );
+        self->priv->next_alarm = 0;
         return TRUE;
     }
-    return FALSE;
-}
+    return FALSE;
+}
+
+static gint64
+get_energy_time_to (Suspend *self,
+                    gdouble  percentage) {
+    gdouble energy;
+
+    if (self->priv->energy_full <= 0 || self->priv->energy_rate <= 0)
+        return -1;
+
+    energy = percentage / 100 * self->priv->energy_full - self->priv->energy;
+    if (energy <= 0)
+        return 0;
+
+    return (gint64) (energy / self->priv->energy_rate * 3600);
+}
+
+static gint64
+get_time_to_percentage (Suspend *self,
+                        gdouble  percentage) {
+    gint64 time_to_percentage;
+
+    // Learnt curve knows about charge tapering, use it if available
+    time_to_percentage = charge_curve_get_time_to (
+        self->priv->charge_curve,
+        self->priv->percentage,
+        percentage
+    );
+
+    // UPower energy is accurate right after plug-in
+    if (time_to_percentage < 0)
+        time_to_percentage = get_energy_time_to (self, percentage);
+
+    if (time_to_percentage < 0)
+        time_to_percentage = charge_model_get_time_to (
+            self->priv->charge_model,
+            self->priv->percentage,
+            percentage
+        );
+
+    return time_to_percentage;
+}
+
+static gint64
+get_alarm_deadline (Suspend *self) {
+    gint64 time_to_threshold_max;
+
+    if (self->priv->next_alarm == 0)
+        return 0;
+
+    time_to_threshold_max = get_time_to_percentage (
+        self, self->priv->threshold_max
+    );
+
+    if (time_to_threshold_max < 0)
+        return 0;
+
+    return self->priv->next_alarm - time_to_threshold_max - ALARM_LEAD_TIME;
+}
+
+static gboolean
+has_alarm_pending (Suspend *self) {
+    gint64 deadline = get_alarm_deadline (self);
+
+    return deadline != 0 && get_current_timestamp () >= deadline;
+}
+
+static gboolean
+handle_input_threshold_alarm (Suspend *self) {
+    if (has_alarm_pending (self)) {
+        g_message ("Alarm pending: %ld", (long) self->priv->next_alarm);
+        request_input_state (self, CONTROL_GROUP_RESUME, "alarm", TRUE);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Hardware thresholds only stop charging, a discharge node drains
+ * battery above max threshold back to end threshold
+ */
+static void
+handle_thresholds_discharge (Suspend *self) {
+    ControlGroup *control_group = self->priv->control_group;
+
+    if (control_group == NULL || !control_group_can_discharge (control_group))
+        return;
+
+    if (self->priv->discharging) {
+        if (self->priv->suspend_lock) {
+            request_input_state (self, CONTROL_GROUP_RESUME, "alarm", TRUE);
+        } else if (self->priv->percentage <= self->priv->threshold_end) {
+            g_message ("Reached end threshold");
+            resume_input (self, "end-threshold");
+        }
+        return;
+    }
+
+    if (!self->priv->suspend_lock &&
+            self->priv->percentage > self->priv->threshold_max) {
+        g_message ("Above max threshold");
+        discharge_input (self, "max-threshold");
+    }
+}
+
+static void
+handle_input_thresholds (Suspend *self) {
+    gint threshold_end = self->priv->threshold_end;
+
+    // Alarm is over, back to normal thresholds
+    if (self->priv->suspend_lock &&
+            get_current_timestamp () >= self->priv->next_alarm) {
+        self->priv->suspend_lock = FALSE;
+        self->priv->next_alarm = get_next_alarm (self);
+    }
+
+    if (!self->priv->suspend_lock && has_alarm_pending (self)) {
+        g_message ("Alarm pending: %ld", (long) self->priv->next_alarm);
+        self->priv->suspend_lock = TRUE;
+    }
+
+    if (self->priv->suspend_lock)
+        threshold_end = self->priv->threshold_max;
+
+    program_thresholds (self, self->priv->threshold_start, threshold_end);
+    handle_thresholds_discharge (self);
+}
+
+static gboolean
+handle_input_discharge (Suspend *self) {
+    ControlGroup *control_group = self->priv->control_group;
+
+    if (control_group == NULL || !control_group_can_discharge (control_group))
+        return FALSE;
+
+    if (self->priv->discharging) {
+        if (handle_input_threshold_alarm (self)) {
+            self->priv->suspend_lock = TRUE;
+        } else if (self->priv->percentage <= self->priv->threshold_end) {
+            g_message ("Reached end threshold");
+            suspend_input (self, "end-threshold");
+        }
+        return TRUE;
+    }
+
+    // Actively drain battery back to thresholds, ie on a dock
+    if (!has_alarm_pending (self) &&
+            self->priv->percentage > self->priv->threshold_max) {
+        g_message ("Above max threshold");
+        self->priv->suspend_lock = FALSE;
+        discharge_input (self, "max-threshold");
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+handle_input (Suspend *self) {
+    self->priv->toggle_retry = 0;
+
+    // Hardware enforces thresholds, only alarms need handling
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS) {
+        handle_input_thresholds (self);
+        return;
+    }
+
+    if (handle_input_discharge (self))
+        return;
+
+    if (self->priv->suspended) {
+        if (handle_input_threshold_start (self)) {
+            self->priv->suspend_lock = FALSE;
+            self->priv->next_alarm = get_next_alarm (self);
+            return;
+        }
+        if (handle_input_threshold_alarm (self)) {
+            self->priv->suspend_lock = TRUE;
+            return;
+        }
+    } else {
+        if (!self->priv->suspend_lock) {
+            if (has_alarm_pending (self)) {
+                g_message ("Alarm pending: %ld", (long) self->priv->next_alarm);
+                self->priv->suspend_lock = TRUE;
+                return;
+            }
+            if (handle_input_threshold_end (self))
+                return;
+        }
+        handle_input_threshold_max (self);
+    }
+}
+
+static gint64
+get_next_deadline (Suspend *self) {
+    /*
+     * Percentage thresholds are driven by UPower updates, only a pending
+     * alarm or a deferred input toggle can change a decision while nothing
+     * else changes
+     */
+    if (self->priv->toggle_retry != 0)
+        return self->priv->toggle_retry;
+
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS)
+        return self->priv->suspend_lock ?
+            self->priv->next_alarm : get_alarm_deadline (self);
+
+    if (self->priv->suspended || !self->priv->suspend_lock)
+        return get_alarm_deadline (self);
+
+    return 0;
+}
+
+static gboolean handle_input_timeout (Suspend *self);
+
+static void
+schedule_input (Suspend *self) {
+    gint64 deadline = get_next_deadline (self);
+    gint64 timestamp = get_current_timestamp ();
+
+    g_clear_handle_id (&self->priv->handle_timeout_id, timer_wheel_remove);
+
+    if (!self->priv->plugged)
+        return;
+
+    if (deadline != 0 && deadline <= timestamp) {
+        handle_input (self);
+        deadline = get_next_deadline (self);
+    }
+
+    if (deadline <= timestamp)
+        return;
+
+    g_message ("Next decision in %lds", (long) (deadline - timestamp));
+    self->priv->handle_timeout_id = timer_wheel_add (
+        deadline,
+        (GSourceFunc) handle_input_timeout,
+        self
+    );
+}
+
+static gint
+get_current_limit (Suspend *self) {
+    Settings *settings = self->priv->settings;
+    gint current_min = settings_get_current_min (settings);
+    gint current_max = settings_get_current_max (settings);
+    gdouble distance;
+    gint step;
+
+    // Alarm needs fast charging
+    if (self->priv->suspend_lock || has_alarm_pending (self))
+        return current_max;
+
+    // Slow down when nearing end threshold, in a few steps
+    distance = self->priv->threshold_end - self->priv->percentage;
+    if (distance <= 0)
+        step = 0;
+    else
+        step = MIN (
+            (gint) (distance * CURRENT_TAPER_STEPS / CURRENT_TAPER_RANGE) + 1,
+            CURRENT_TAPER_STEPS
+        );
+
+    return current_min +
+        (current_max - current_min) * step / CURRENT_TAPER_STEPS;
+}
+
+static void
+on_current_limit_written (ControlNode *control_node,
+                          gboolean     written,
+                          gpointer     user_data) {
+    Suspend *self = SUSPEND (user_data);
+
+    // Write again on next update
+    if (!written)
+        self->priv->current_limit = -1;
+}
+
+/*
+ * Chargers may reset current limit when renegotiated
+ */
+static void
+reset_current_limit (Suspend *self) {
+    const gchar *path = settings_get_sysfs_current_path (
+        self->priv->settings
+    );
+
+    if (path == NULL)
+        return;
+
+    control_node_invalidate (control_node_get (path));
+    self->priv->current_limit = -1;
+}
+
+static void
+update_current_limit (Suspend *self) {
+    const gchar *path = settings_get_sysfs_current_path (
+        self->priv->settings
+    );
+    gint current_limit;
+
+    if (path == NULL || !self->priv->plugged)
+        return;
+
+    current_limit = get_current_limit (self);
+    if (current_limit == self->priv->current_limit)
+        return;
+
+    g_message ("Charge current limit: %d", current_limit);
+    write_sysfs_value (path, current_limit, on_current_limit_written, self);
+    self->priv->current_limit = current_limit;
+    set_statistic (self, "current-limit", g_variant_new_int32 (current_limit));
+}
+
+static void
+update_input (Suspend *self) {
+    // Battery level unknown until first sample
+    if (!self->priv->plugged || self->priv->start_time != 0)
+        return;
+
+    handle_input (self);
+    update_current_limit (self);
+    schedule_input (self);
+}
+
+static gboolean
+handle_input_timeout (Suspend *self) {
+    self->priv->handle_timeout_id = 0;
+    self->priv->timer_wakeups += 1;
+
+    set_statistic (
+        self,
+        "timer-wakeups",
+        g_variant_new_uint32 (self->priv->timer_wakeups)
+    );
+
+    update_input (self);
+
+    return FALSE;
+}
+
+static void
+add_charge_sample (Suspend *self) {
+    gint64 timestamp = get_current_timestamp ();
+
+    charge_model_add_sample (
+        self->priv->charge_model, timestamp, self->priv->percentage
+    );
+    charge_curve_add_sample (
+        self->priv->charge_curve, timestamp, self->priv->percentage
+    );
+}
+
+static void
+log_percentage (Suspend *self) {
+    const gchar *status;
+    gint64 timestamp;
+
+    if (self->priv->previous_percentage == 0)
+        return;
+
+    timestamp = get_current_timestamp ();
+
+    if (self->priv->percentage > self->priv->previous_percentage)
+        status = "Charging";
+    else
+        status = "Discharging";
+
+    timestamp = self->priv->next_alarm - timestamp;
+    if (timestamp > 0) {
+        g_message (
+            "%s: %.1f (%ld)",
+            status,
+            self->priv->percentage,
+            (long) timestamp
+        );
+    } else {
+        g_message (
+            "%s: %.1f",
+            status,
+            self->priv->percentage
+        );
+    }
+}
+
+static void
+handle_time_to_full (Suspend  *self,
+                     GVariant *data) {
+    gint64 time_to_full = g_variant_get_int64 (data);
+
+    // UPower reports 0 or very low values until it has enough data
+    if (self->priv->suspended || time_to_full < MIN_TIME_TO_FULL)
+        return;
+
+    charge_model_add_rate (
+        self->priv->charge_model,
+        (100 - self->priv->percentage) / time_to_full
+    );
+
+    g_message("Time to full: %ld", (long) time_to_full);
+}
+
+/*
+ * Both configured and hysteresis adjusted thresholds bound bands, a
+ * decision suppressed at one is taken at the other
+ */
+static gint
+get_percentage_band (Suspend *self,
+                     gdouble  percentage) {
+    return (percentage > get_effective_start (self)) +
+        (percentage > self->priv->threshold_start) +
+        (percentage >= self->priv->threshold_end) +
+        (percentage >= get_effective_end (self)) +
+        (percentage >= self->priv->threshold_max);
+}
+
+static gboolean
+handle_percentage (Suspend  *self,
+                   GVariant *data) {
+    self->priv->previous_percentage = self->priv->percentage;
+    self->priv->percentage = g_variant_get_double (data);
+
+    log_percentage (self);
+
+    if (self->priv->plugged && !self->priv->suspended)
+        add_charge_sample (self);
+
+    // Any threshold crossed, in either direction, needs a decision
+    return get_percentage_band (self, self->priv->previous_percentage) !=
+        get_percentage_band (self, self->priv->percentage);
+}
+
+static void
+start_handling_input (Suspend *self) {
+    if (!self->priv->plugged)
+        return;
+
+    update_input (self);
+}
+
+static void
+update_charger_type (Suspend *self) {
+    g_autofree gchar *charger_type = power_supply_get_charger_type ();
+
+    charge_curve_set_type (self->priv->charge_curve, charger_type);
+}
+
+/*
+ * Nodes driven by this loop, exposed by GetControl
+ */
+static void
+publish_control (Suspend *self) {
+    Settings *settings = self->priv->settings;
+    const gchar *path = NULL;
+
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS)
+        path = settings_get_sysfs_end_threshold_path (settings);
+    else if (self->priv->control_group != NULL)
+        path = control_group_get_path (self->priv->control_group, 0);
+
+    if (!settings_has_control (settings))
+        return;
+
+    bim_bus_set_control (
+        bim_bus_get_default (), settings_get_control_class (settings), path
+    );
+    set_statistic (
+        self,
+        "control-path",
+        g_variant_new_string (path != NULL ? path : "")
+    );
+}
+
+static void
+on_input_released (ControlGroup *control_group,
+                   gboolean      applied,
+                   gpointer      user_data) {
+    Suspend *self = SUSPEND (user_data);
+    gboolean dropped = self->priv->input_dropped;
+
+    self->priv->input_pending = FALSE;
+    self->priv->input_dropped = FALSE;
+    g_object_unref (control_group);
+
+    if (!applied)
+        g_warning ("Can't resume previous input");
+
+    replay_dropped (self, dropped);
+}
+
+static void
+on_input_moved (ControlGroup *control_group,
+                gboolean      applied,
+                gpointer      user_data) {
+    Suspend *self = SUSPEND (user_data);
+    ControlGroup *previous = g_steal_pointer (&self->priv->previous_group);
+    ControlGroup *released;
+    gchar buffer[16];
+
+    if (!applied) {
+        g_warning ("Can't move input state, retrying");
+        g_clear_pointer (&self->priv->control_input, g_free);
+        g_set_object (&self->priv->control_group, previous);
+        g_object_unref (previous);
+        publish_control (self);
+        self->priv->input_pending = FALSE;
+        self->priv->toggle_retry = get_current_timestamp () +
+            INPUT_RETRY_DELAY;
+        schedule_input (self);
+        return;
+    }
+
+    save_input_state (self);
+
+    // Previous charger charges again once back, shared nodes stay as is
+    released = CONTROL_GROUP (
+        control_group_new_difference (previous, control_group)
+    );
+    g_object_unref (previous);
+    g_snprintf (buffer, sizeof (buffer), "%d", self->priv->input_fallback);
+    control_group_apply (
+        released, CONTROL_GROUP_RESUME, buffer, on_input_released, self
+    );
+}
+
+/*
+ * Charger changed while input is suspended: suspend new charger nodes
+ * first, then resume previous ones
+ */
+static void
+move_input_state (Suspend      *self,
+                  ControlGroup *control_group) {
+    gchar buffer[16];
+
+    g_snprintf (buffer, sizeof (buffer), "%d", self->priv->input_fallback);
+
+    // Last request may have failed, move actual state
+    self->priv->input_request = self->priv->discharging ?
+        CONTROL_GROUP_DISCHARGE : CONTROL_GROUP_SUSPEND;
+    self->priv->input_pending = TRUE;
+    self->priv->previous_group = g_steal_pointer (&self->priv->control_group);
+    self->priv->control_group = g_object_ref (control_group);
+    publish_control (self);
+    control_group_apply (
+        control_group,
+        self->priv->input_request,
+        buffer,
+        on_input_moved,
+        self
+    );
+}
+
+/*
+ * Route input control to the online charger
+ */
+static void
+update_control_group (Suspend *self) {
+    g_autofree gchar *input = NULL;
+    ControlGroup *control_group;
+
+    // Checked again once nodes are written
+    if (self->priv->input_pending) {
+        self->priv->control_dropped = TRUE;
+        return;
+    }
 
-static gboolean
-handle_input_threshold_max (Suspend *self) {
-    if (self->priv->percentage >= self->priv->threshold_max) {
-        g_message ("Reached max threshold");
-        suspend_input (self);
-        self->priv->next_alarm = 0;
-        return TRUE;
+    // Hardware handles thresholds, nodes are only used to drain battery
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS) {
+        if (self->priv->suspended)
+            return;
+        g_set_object (
+            &self->priv->control_group,
+            settings_get_discharge_group (self->priv->settings)
+        );
+        publish_control (self);
+        return;
     }
-    return FALSE;
-}
 
-static gboolean
-has_alarm_pending (Suspend *self) {
-    if (self->priv->next_alarm != 0 &&
-            self->priv->time_to_full != 0) {
-        g_autoptr(GDateTime) datetime;
-        gint64 timestamp;
-        gint64 time_to_threshold_max = self->priv->time_to_full +
-            TIME_TO_FULL_DELTA;
-
-        datetime = g_date_time_new_now_utc ();
-        timestamp = g_date_time_to_unix (datetime);
-
-        if (self->priv->threshold_max != 100) {
-            time_to_threshold_max = self->priv->time_to_full / (
-                100 - self->priv->percentage
-            ) * (100 - self->priv->threshold_max);
-        }
+    // Keep current charger while online, several may be
+    if (self->priv->control_input != NULL) {
+        g_autofree gchar *online = power_supply_get_attribute (
+            self->priv->control_input, "online"
+        );
 
-        if (self->priv->next_alarm - timestamp < time_to_threshold_max)
-            return TRUE;
+        if (online != NULL && g_strcmp0 (online, "0") != 0)
+            return;
     }
-    return FALSE;
-}
-static gboolean
-handle_input_threshold_alarm (Suspend *self) {
-    if (has_alarm_pending (self)) {
-        g_message ("Alarm pending: %ld", (long) self->priv->next_alarm);
-        resume_input (self);
-        return TRUE;
+
+    input = power_supply_get_online_input ();
+
+    // A suspended charger may look offline, keep its nodes
+    if (input == NULL && self->priv->suspended)
+        return;
+
+    g_free (self->priv->control_input);
+    self->priv->control_input = g_strdup (input);
+
+    control_group = settings_get_input_control_group (
+        self->priv->settings, input
+    );
+    if (control_group == self->priv->control_group)
+        return;
+
+    if (control_group != NULL && input != NULL)
+        g_message (
+            "Controlling input %s: %s",
+            input,
+            control_group_get_path (control_group, 0)
+        );
+
+    if (self->priv->suspended && control_group != NULL &&
+            self->priv->control_group != NULL) {
+        move_input_state (self, control_group);
+        return;
     }
-    return FALSE;
+
+    g_set_object (&self->priv->control_group, control_group);
+    publish_control (self);
 }
 
 static void
-handle_input (Suspend *self) {
-    if (self->priv->suspended) {
-        if (handle_input_threshold_start (self)) {
-            self->priv->suspend_lock = FALSE;
-            self->priv->next_alarm = bim_bus_get_next_alarm (
-                bim_bus_get_default ()
-            );
-            return;
-        }
-        if (handle_input_threshold_alarm (self)) {
-            self->priv->suspend_lock = TRUE;
-            return;
-        }
+set_plugged (Suspend  *self,
+             gboolean  plugged) {
+    if (self->priv->plugged == plugged)
+        return;
+
+    self->priv->plugged = plugged;
+
+    if (plugged) {
+        g_message ("Charger plugged");
+        self->priv->plugged_timestamp = get_current_timestamp ();
+        charge_model_reset (self->priv->charge_model);
+        self->priv->energy_rate = 0;
+        update_charger_type (self);
+        reset_current_limit (self);
+        update_control_group (self);
+        self->priv->next_alarm = get_next_alarm (self);
+        start_handling_input (self);
     } else {
-        if (!self->priv->suspend_lock) {
-            if (has_alarm_pending (self)) {
-                g_message ("Alarm pending: %ld", (long) self->priv->next_alarm);
-                self->priv->suspend_lock = TRUE;
-                return;
-            }
-            if (handle_input_threshold_end (self))
-                return;
+        gint64 timestamp = get_current_timestamp ();
+
+        g_message ("Charger unplugged");
+        if (self->priv->plugged_timestamp != 0 &&
+                timestamp - self->priv->plugged_timestamp >=
+                    HABITS_MIN_PLUGGED) {
+            habits_add_unplug (self->priv->habits, timestamp);
+            habits_save (self->priv->habits);
         }
-        handle_input_threshold_max (self);
+        self->priv->plugged_timestamp = 0;
+        charge_curve_save (self->priv->charge_curve);
+        g_clear_handle_id (&self->priv->handle_timeout_id, timer_wheel_remove);
     }
 }
 
 static gboolean
-handle_input_timeout (Suspend *self) {
-    handle_input (self);
+check_online (Suspend *self) {
+    gboolean online;
 
-    self->priv->handle_timeout_id = g_timeout_add (
-        REFRESH_RATE,
-        (GSourceFunc) handle_input_timeout,
-        self
-    );
+    self->priv->online_timeout_id = 0;
+
+    if (!self->priv->suspended && power_supply_get_online (&online))
+        set_plugged (self, online);
 
     return FALSE;
 }
 
 static void
-log_percentage (Suspend *self) {
-    g_autoptr(GDateTime) datetime;
-    const gchar *status;
-    gint64 timestamp;
+on_online_changed (BatterySource *source,
+                   gboolean       online,
+                   gpointer       user_data) {
+    Suspend *self = SUSPEND (user_data);
 
-    if (self->priv->previous_percentage == 0)
-        return;
+    /*
+     * A suspended input may look like an unplugged charger, keep the
+     * plan. Other classes keep their charger online.
+     */
+    if (self->priv->suspended && input_is_cut (self))
+        online = TRUE;
 
-    datetime = g_date_time_new_now_utc ();
-    timestamp = g_date_time_to_unix (datetime);
+    set_plugged (self, online);
 
-    if (self->priv->percentage > self->priv->previous_percentage)
-        status = "Charging";
-    else
-        status = "Discharging";
+    // Charger may change without an unplug
+    if (self->priv->plugged)
+        update_control_group (self);
+}
 
-    timestamp = self->priv->next_alarm - timestamp;
-    if (timestamp > 0) {
-        g_message (
-            "%s: %d (%ld)",
-            status,
-            self->priv->percentage,
-            (long) timestamp
-        );
-    } else {
-        g_message (
-            "%s: %d",
-            status,
-            self->priv->percentage
+static void
+handle_energy (Suspend  *self,
+               GVariant *energy,
+               GVariant *energy_full,
+               GVariant *energy_rate) {
+    if (energy != NULL)
+        self->priv->energy = g_variant_get_double (energy);
+    if (energy_full != NULL)
+        self->priv->energy_full = g_variant_get_double (energy_full);
+
+    // Keep charging rate, it is needed while input is suspended
+    if (energy_rate != NULL &&
+            self->priv->plugged &&
+            !self->priv->suspended &&
+            self->priv->energy_full > 0 &&
+            g_variant_get_double (energy_rate) > 0) {
+        self->priv->energy_rate = g_variant_get_double (energy_rate);
+        charge_model_add_rate (
+            self->priv->charge_model,
+            self->priv->energy_rate / self->priv->energy_full / 36
         );
     }
 }
 
 static void
-handle_time_to_full (Suspend  *self,
-                     GVariant *data) {
-    if (!self->priv->suspended) {
-        if (self->priv->previous_time_to_full == 0) {
-            self->priv->time_to_full = g_variant_get_int64 (data);
-        } else {
-            self->priv->previous_time_to_full = self->priv->time_to_full;
-            self->priv->time_to_full = (
-                g_variant_get_int64 (data) + self->priv->previous_time_to_full
-            ) / 2;
-        }
-
-        if (self->priv->time_to_full < MIN_TIME_TO_FULL) {
-            self->priv->time_to_full = MIN_TIME_TO_FULL;
-        }
+handle_sample (Suspend  *self,
+               GVariant *properties) {
+    g_autoptr(GVariant) percentage = NULL;
+    g_autoptr(GVariant) time_to_full = NULL;
+    g_autoptr(GVariant) energy = NULL;
+    g_autoptr(GVariant) energy_full = NULL;
+    g_autoptr(GVariant) energy_rate = NULL;
+    gboolean crossed = FALSE;
+
+    percentage = g_variant_lookup_value (
+        properties, "Percentage", G_VARIANT_TYPE_DOUBLE
+    );
+    time_to_full = g_variant_lookup_value (
+        properties, "TimeToFull", G_VARIANT_TYPE_INT64
+    );
+    energy = g_variant_lookup_value (
+        properties, "Energy", G_VARIANT_TYPE_DOUBLE
+    );
+    energy_full = g_variant_lookup_value (
+        properties, "EnergyFull", G_VARIANT_TYPE_DOUBLE
+    );
+    energy_rate = g_variant_lookup_value (
+        properties, "EnergyRate", G_VARIANT_TYPE_DOUBLE
+    );
 
-        g_message("Time to full: %ld", (long) self->priv->time_to_full);
+    handle_energy (self, energy, energy_full, energy_rate);
+    if (percentage != NULL)
+        crossed = handle_percentage (self, percentage);
+    if (time_to_full != NULL)
+        handle_time_to_full (self, time_to_full);
+
+    if (crossed)
+        update_input (self);
+    else if (percentage != NULL || time_to_full != NULL ||
+             energy != NULL || energy_rate != NULL) {
+        update_current_limit (self);
+        schedule_input (self);
     }
 }
 
 static void
-handle_percentage (Suspend  *self,
-                   GVariant *data) {
-    self->priv->previous_percentage = self->priv->percentage;
-    self->priv->percentage = (gint32) g_variant_get_double (data);
+on_sample (BatterySource *source,
+           GVariant      *sample,
+           gpointer       user_data) {
+    Suspend *self = SUSPEND (user_data);
 
-    log_percentage (self);
+    handle_sample (self, sample);
 
-    // We will need some more time to full
-    if (self->priv->percentage < self->priv->previous_percentage) {
-        self->priv->time_to_full += self->priv->time_to_full / (
-             100 - self->priv->previous_percentage
+    // Charger may change without any online change
+    if (self->priv->plugged && settings_has_routes (self->priv->settings))
+        update_control_group (self);
+
+    // Sources may wait for their backend, start once battery is known
+    if (self->priv->start_time != 0) {
+        set_statistic (
+            self,
+            "first-sample-time",
+            g_variant_new_int64 (
+                (g_get_monotonic_time () - self->priv->start_time) / 1000
+            )
         );
+        self->priv->start_time = 0;
+        start_handling_input (self);
     }
-
-    if (self->priv->percentage == self->priv->threshold_start ||
-            self->priv->percentage == self->priv->threshold_end ||
-            self->priv->percentage == self->priv->threshold_max)
-        handle_input (self);
 }
 
-static gboolean
-simulate_charging_cycle (Suspend *self) {
-    self->priv->previous_percentage = self->priv->percentage;
-    if (self->priv->suspended)
-        self->priv->percentage -= 1;
-    else
-        self->priv->percentage += 1;
-
-    log_percentage (self);
-    handle_input (self);
+static void
+on_alarm_updated (BimBus  *bim_bus,
+                  gpointer user_data) {
+    Suspend *self = SUSPEND (user_data);
 
-    return TRUE;
+    self->priv->next_alarm = get_next_alarm (self);
+    update_input (self);
 }
 
 static void
-start_handling_input (Suspend *self) {
-    g_clear_handle_id (&self->priv->handle_timeout_id, g_source_remove);
+on_prepare_for_sleep (WakeAlarm *wake_alarm,
+                      gpointer   user_data) {
+    Suspend *self = SUSPEND (user_data);
+    gint64 deadline;
+    gint64 time_to_threshold;
 
-    if (self->priv->simulate) {
-        GRand *rand = g_rand_new ();
+    if (!self->priv->plugged)
+        return;
 
-        self->priv->time_to_full =  g_rand_int_range (rand, 20, 40);
-        g_free (rand);
+    deadline = get_next_deadline (self);
 
-        self->priv->handle_timeout_id = g_timeout_add (
-            REFRESH_RATE_SIMULATE,
-            (GSourceFunc) simulate_charging_cycle,
-            self
-        );
-    } else {
-        self->priv->handle_timeout_id = g_timeout_add (
-            REFRESH_RATE_START,
-            (GSourceFunc) handle_input_timeout,
-            self
+    // Nothing reports percentage while sleeping, wake up at next threshold
+    if (!self->priv->suspended) {
+        time_to_threshold = get_time_to_percentage (
+            self,
+            self->priv->suspend_lock ?
+                self->priv->threshold_max : self->priv->threshold_end
         );
+
+        if (time_to_threshold > 0) {
+            gint64 threshold_deadline =
+                get_current_timestamp () + time_to_threshold;
+
+            if (deadline == 0 || threshold_deadline < deadline)
+                deadline = threshold_deadline;
+        }
     }
+
+    wake_alarm_request (wake_alarm, deadline);
 }
 
 static void
-on_upower_proxy_properties (GDBusProxy  *proxy,
-                            GVariant    *changed_properties,
-                            char       **invalidated_properties,
-                            gpointer     user_data)
-{
-    Suspend *self = user_data;
-    GVariant *value;
-    char *property;
-    GVariantIter i;
-
-    g_variant_iter_init (&i, changed_properties);
-    while (g_variant_iter_next (&i, "{&sv}", &property, &value)) {
-        if (g_strcmp0 (property, "TimeToFull") == 0) {
-            handle_time_to_full (self, value);
-        } else if (g_strcmp0 (property, "Percentage") == 0) {
-            handle_percentage (self, value);
-        }
+on_clock_changed (TimerWheel *timer_wheel,
+                  gpointer    user_data) {
+    Suspend *self = SUSPEND (user_data);
 
-        g_variant_unref (value);
-    }
+    // Deadlines are absolute, alarms may now be pending
+    update_input (self);
 }
 
 static void
-on_alarm_updated (BimBus  *bim_bus,
-                  gpointer user_data) {
+on_resumed (WakeAlarm *wake_alarm,
+            gpointer   user_data) {
     Suspend *self = SUSPEND (user_data);
 
-    self->priv->next_alarm = bim_bus_get_next_alarm (bim_bus);
+    g_message ("Resumed from sleep");
+
+    // GLib timers are not aware of time spent sleeping
+    update_input (self);
+}
+
+static gboolean
+update_idle (Suspend *self) {
+    self->priv->update_idle_id = 0;
+
+    start_handling_input (self);
+
+    return FALSE;
+}
+
+static void
+queue_update (Suspend *self) {
+    // Coalesce settings changes into one update per main loop iteration
+    if (self->priv->update_idle_id == 0)
+        self->priv->update_idle_id = g_idle_add (
+            (GSourceFunc) update_idle, self
+        );
 }
 
 static void
@@ -379,41 +1513,195 @@ on_setting_changed (BimBus   *bim_bus,
         self->priv->threshold_start = value;
     else if (g_strcmp0 (setting, "threshold-end") == 0)
         self->priv->threshold_end = value;
+    else if (g_strcmp0 (setting, "hysteresis") == 0)
+        self->priv->hysteresis = MAX (value, 0);
+    else if (g_strcmp0 (setting, "dwell-time") == 0)
+        self->priv->dwell_time = MAX (value, 0);
+    else if (g_strcmp0 (setting, "toggles-per-hour") == 0)
+        self->priv->toggles_per_hour = CLAMP (
+            value, 1, INPUT_TOGGLES_HISTORY
+        );
 
-    start_handling_input (self);
+    queue_update (self);
 }
 
 static void
-suspend_connect_upower (Suspend *self) {
-    if (self->priv->simulate) {
-        self->priv->percentage = SIMULATE_CYCLE_START;
-    } else {
-        g_autoptr (GError) error = NULL;
-
-        self->priv->upower_proxy = g_dbus_proxy_new_for_bus_sync (
-            G_BUS_TYPE_SYSTEM,
-            0,
-            NULL,
-            UPOWER_DBUS_NAME,
-            UPOWER_DBUS_PATH,
-            UPOWER_DBUS_INTERFACE,
-            NULL,
-            &error
+on_thresholds_changed (BimBus   *bim_bus,
+                       gint      max,
+                       gint      start,
+                       gint      end,
+                       gpointer  user_data) {
+    Suspend *self = SUSPEND (user_data);
+
+    g_message ("Thresholds changed: %d %d %d", max, start, end);
+
+    self->priv->threshold_max = max;
+    self->priv->threshold_start = start;
+    self->priv->threshold_end = end;
+
+    queue_update (self);
+}
+
+static ControlGroupState
+get_input_state (const gchar *name) {
+    gint state;
+
+    for (state = 0; state < CONTROL_GROUP_LAST; state++)
+        if (g_strcmp0 (name, INPUT_STATES[state]) == 0)
+            return state;
+
+    return CONTROL_GROUP_LAST;
+}
+
+/*
+ * Nodes may still hold a previous run decision: rebuild state from
+ * nodes instead of assuming a resumed input. State file tells which
+ * nodes were written, with which value, and keeps last decision time
+ * for dwell time when it agrees with nodes.
+ */
+static void
+restore_input_state (Suspend *self) {
+    g_autoptr (GKeyFile) key_file = NULL;
+    g_autofree gchar *filename = NULL;
+    g_autofree gchar *saved_state = NULL;
+    g_autofree gchar *reason = NULL;
+    g_autofree gchar *input = NULL;
+    ControlGroupState state;
+    gint64 timestamp = 0;
+    gboolean loaded;
+    gchar buffer[16];
+
+    if (self->priv->simulate)
+        return;
+
+    filename = get_state_filename (self, INPUT_STATE_FILE);
+    key_file = g_key_file_new ();
+    loaded = g_key_file_load_from_file (
+        key_file, filename, G_KEY_FILE_NONE, NULL
+    );
+    if (loaded) {
+        saved_state = g_key_file_get_string (
+            key_file, INPUT_STATE_GROUP, "State", NULL
         );
+        reason = g_key_file_get_string (
+            key_file, INPUT_STATE_GROUP, "Reason", NULL
+        );
+        input = g_key_file_get_string (
+            key_file, INPUT_STATE_GROUP, "Input", NULL
+        );
+        timestamp = g_key_file_get_int64 (
+            key_file, INPUT_STATE_GROUP, "Timestamp", NULL
+        );
+        if (g_key_file_has_key (key_file, INPUT_STATE_GROUP, "Fallback", NULL))
+            self->priv->input_fallback = g_key_file_get_integer (
+                key_file, INPUT_STATE_GROUP, "Fallback", NULL
+            );
+    }
 
-        if (error != NULL) {
-            g_error("Can't contact UPower: %s", error->message);
-            return;
-        }
+    // A suspended charger looks offline, read back written nodes
+    if (input != NULL) {
+        g_set_object (
+            &self->priv->control_group,
+            settings_get_input_control_group (self->priv->settings, input)
+        );
+        g_free (self->priv->control_input);
+        self->priv->control_input = g_steal_pointer (&input);
+        publish_control (self);
+    }
+
+    if (self->priv->control_group == NULL)
+        return;
+
+    g_snprintf (buffer, sizeof (buffer), "%d", self->priv->input_fallback);
+    if (!control_group_read_state (self->priv->control_group, buffer, &state)) {
+        // Never leave a charger cut without a plan
+        g_message ("Unknown input state, resuming");
+        apply_input_state (self, CONTROL_GROUP_RESUME, "unknown");
+        return;
+    }
+
+    self->priv->input_request = state;
+    self->priv->suspended = state != CONTROL_GROUP_RESUME;
+    self->priv->discharging = state == CONTROL_GROUP_DISCHARGE;
+    battery_source_set_charging (
+        self->priv->source, !self->priv->suspended
+    );
+    if (self->priv->suspended)
+        bim_bus_input_suspended (bim_bus_get_default (), TRUE, 0);
+
+    // Nodes changed behind our back, only trust them
+    if (!loaded || get_input_state (saved_state) != state ||
+            timestamp <= 0 || timestamp > get_current_timestamp ()) {
+        g_message ("Input state: %s", INPUT_STATES[state]);
+        return;
+    }
 
-        g_signal_connect (
-            self->priv->upower_proxy,
-            "g-properties-changed",
-            G_CALLBACK (on_upower_proxy_properties),
-            self
+    g_message (
+        "Input state: %s (%s, %lds ago)",
+        INPUT_STATES[state],
+        reason != NULL ? reason : "unknown",
+        (long) (get_current_timestamp () - timestamp)
+    );
+    add_toggle (self, timestamp);
+}
+
+static void
+suspend_connect_source (Suspend *self) {
+    g_autofree gchar *charge_curves = NULL;
+    g_autofree gchar *habits = NULL;
+    Settings *settings = self->priv->settings;
+
+    self->priv->control_mode = settings_get_control_mode (settings);
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_THRESHOLDS) {
+        self->priv->programmed_start = read_sysfs_value (
+            settings_get_sysfs_start_threshold_path (settings)
+        );
+        self->priv->programmed_end = read_sysfs_value (
+            settings_get_sysfs_end_threshold_path (settings)
         );
     }
-    start_handling_input (self);
+
+    // Do not learn from simulated charge cycles
+    if (!self->priv->simulate) {
+        charge_curves = get_state_filename (self, CHARGE_CURVES_FILE);
+        habits = get_state_filename (self, HABITS_FILE);
+    }
+    self->priv->charge_curve = CHARGE_CURVE (charge_curve_new (charge_curves));
+    self->priv->habits = HABITS (habits_new (habits));
+
+    if (!power_supply_get_online (&self->priv->plugged))
+        self->priv->plugged = TRUE;
+
+    update_control_group (self);
+    publish_control (self);
+    if (self->priv->control_mode == SETTINGS_CONTROL_MODE_INPUT)
+        restore_input_state (self);
+
+    // A suspended input may look like an unplugged charger
+    if (self->priv->suspended && input_is_cut (self))
+        self->priv->plugged = TRUE;
+
+    if (self->priv->plugged) {
+        self->priv->plugged_timestamp = get_current_timestamp ();
+        update_charger_type (self);
+    }
+
+    g_signal_connect (
+        self->priv->source,
+        "sample",
+        G_CALLBACK (on_sample),
+        self
+    );
+
+    g_signal_connect (
+        self->priv->source,
+        "online-changed",
+        G_CALLBACK (on_online_changed),
+        self
+    );
+
+    self->priv->start_time = g_get_monotonic_time ();
+    battery_source_start (self->priv->source);
 }
 
 static void
@@ -425,9 +1713,14 @@ suspend_set_property (GObject *object,
     Suspend *self = SUSPEND (object);
 
     switch (property_id) {
+        case PROP_SOURCE:
+            self->priv->source = g_value_dup_object (value);
+            return;
+        case PROP_SETTINGS:
+            self->priv->settings = g_value_dup_object (value);
+            return;
         case PROP_SIMULATE:
             self->priv->simulate = g_value_get_boolean (value);
-            suspend_connect_upower (self);
             return;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -459,14 +1752,34 @@ suspend_dispose (GObject *suspend)
 {
     Suspend *self = SUSPEND (suspend);
 
-    g_clear_handle_id (&self->priv->handle_timeout_id, g_source_remove);
-
-    if (!self->priv->simulate)
-        g_clear_object (&self->priv->upower_proxy);
+    g_clear_handle_id (&self->priv->handle_timeout_id, timer_wheel_remove);
+    g_clear_handle_id (&self->priv->update_idle_id, g_source_remove);
+    g_clear_handle_id (&self->priv->online_timeout_id, g_source_remove);
+
+    if (self->priv->source != NULL)
+        g_signal_handlers_disconnect_by_data (self->priv->source, self);
+    g_clear_object (&self->priv->source);
+    g_clear_object (&self->priv->settings);
+    g_clear_object (&self->priv->control_group);
+    g_clear_object (&self->priv->previous_group);
+    g_clear_pointer (&self->priv->control_input, g_free);
+    g_clear_object (&self->priv->charge_model);
+    g_clear_object (&self->priv->charge_curve);
+    g_clear_object (&self->priv->habits);
 
     G_OBJECT_CLASS (suspend_parent_class)->dispose (suspend);
 }
 
+static void
+suspend_constructed (GObject *suspend)
+{
+    Suspend *self = SUSPEND (suspend);
+
+    G_OBJECT_CLASS (suspend_parent_class)->constructed (suspend);
+
+    suspend_connect_source (self);
+}
+
 static void
 suspend_finalize (GObject *suspend)
 {
@@ -479,18 +1792,45 @@ suspend_class_init (SuspendClass *klass)
     GObjectClass *object_class;
 
     object_class = G_OBJECT_CLASS (klass);
+    object_class->constructed = suspend_constructed;
     object_class->dispose = suspend_dispose;
     object_class->finalize = suspend_finalize;
     object_class->set_property = suspend_set_property;
     object_class->get_property = suspend_get_property;
 
+    g_object_class_install_property (
+        object_class,
+        PROP_SOURCE,
+        g_param_spec_object (
+            "source",
+            "Battery source",
+            "Battery source",
+            TYPE_BATTERY_SOURCE,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+
+    g_object_class_install_property (
+        object_class,
+        PROP_SETTINGS,
+        g_param_spec_object (
+            "settings",
+            "Settings",
+            "Control nodes of battery",
+            TYPE_SETTINGS,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+
     g_object_class_install_property (
         object_class,
         PROP_SIMULATE,
         g_param_spec_boolean (
             "simulate",
-            "Simulate a charging cycle",
-            "Simulate a charging cycle",
+            "Simulated battery",
+            "Simulated battery, do not learn from it",
             FALSE,
             G_PARAM_WRITABLE|
             G_PARAM_CONSTRUCT_ONLY
@@ -506,17 +1846,57 @@ suspend_init (Suspend *self)
     self->priv->percentage = 0;
     self->priv->previous_percentage = 0;
 
+    self->priv->energy = 0;
+    self->priv->energy_full = 0;
+    self->priv->energy_rate = 0;
+
     self->priv->suspended = FALSE;
+    self->priv->discharging = FALSE;
+    self->priv->input_pending = FALSE;
+    self->priv->input_dropped = FALSE;
+    self->priv->control_dropped = FALSE;
+    self->priv->input_request = CONTROL_GROUP_RESUME;
+    self->priv->input_reason = NULL;
+    self->priv->input_fallback = INPUT_THRESHOLD_START;
     self->priv->suspend_lock = FALSE;
+    self->priv->plugged = TRUE;
+
+    self->priv->handle_timeout_id = 0;
+    self->priv->source = NULL;
+    self->priv->settings = NULL;
+    self->priv->update_idle_id = 0;
+    self->priv->online_timeout_id = 0;
+    self->priv->timer_wakeups = 0;
+
+    self->priv->control_mode = SETTINGS_CONTROL_MODE_INPUT;
+    self->priv->control_group = NULL;
+    self->priv->previous_group = NULL;
+    self->priv->control_input = NULL;
+    self->priv->programmed_start = -1;
+    self->priv->programmed_end = -1;
+    self->priv->current_limit = -1;
 
     self->priv->next_alarm = 0;
-    self->priv->time_to_full = 0;
-    self->priv->previous_time_to_full = 0;
+    self->priv->plugged_timestamp = 0;
+    self->priv->start_time = 0;
+    self->priv->charge_model = CHARGE_MODEL (charge_model_new ());
 
     self->priv->threshold_max = INPUT_THRESHOLD_MAX;
     self->priv->threshold_start = INPUT_THRESHOLD_START;
     self->priv->threshold_end = INPUT_THRESHOLD_END;
 
+    self->priv->hysteresis = INPUT_HYSTERESIS;
+    self->priv->dwell_time = INPUT_DWELL_TIME;
+    self->priv->toggles_per_hour = INPUT_TOGGLES_PER_HOUR;
+
+    memset (self->priv->toggles, 0, sizeof (self->priv->toggles));
+    self->priv->toggles_index = 0;
+    self->priv->toggle_retry = 0;
+    self->priv->suppressed_dwell = 0;
+    self->priv->suppressed_budget = 0;
+    self->priv->suppressed_hysteresis = 0;
+    self->priv->hysteresis_state = CONTROL_GROUP_LAST;
+
     g_signal_connect (
         bim_bus_get_default (),
         "alarm-added",
@@ -537,6 +1917,34 @@ suspend_init (Suspend *self)
         G_CALLBACK (on_setting_changed),
         self
     );
+
+    g_signal_connect (
+        bim_bus_get_default (),
+        "thresholds-changed",
+        G_CALLBACK (on_thresholds_changed),
+        self
+    );
+
+    g_signal_connect (
+        timer_wheel_get_default (),
+        "clock-changed",
+        G_CALLBACK (on_clock_changed),
+        self
+    );
+
+    g_signal_connect (
+        wake_alarm_get_default (),
+        "prepare-for-sleep",
+        G_CALLBACK (on_prepare_for_sleep),
+        self
+    );
+
+    g_signal_connect (
+        wake_alarm_get_default (),
+        "resumed",
+        G_CALLBACK (on_resumed),
+        self
+    );
 }
 
 /**
@@ -544,15 +1952,27 @@ suspend_init (Suspend *self)
  *
  * Creates a new #Suspend
  *
+ * @source: a #BatterySource
+ * @settings: control nodes of battery
+ * @simulate: TRUE if source is simulated
+ *
  * Returns: (transfer full): a new #Suspend
  *
  **/
 GObject *
-suspend_new (gboolean simulate)
+suspend_new (BatterySource *source,
+             Settings      *settings,
+             gboolean       simulate)
 {
     GObject *suspend;
 
-    suspend = g_object_new (TYPE_SUSPEND, "simulate", simulate, NULL);
+    suspend = g_object_new (
+        TYPE_SUSPEND,
+        "source", source,
+        "settings", settings,
+        "simulate", simulate,
+        NULL
+    );
 
     return suspend;
 }
@@ -8,6 +8,9 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "battery_source.h"
+#include "settings.h"
+
 #define TYPE_SUSPEND \
     (suspend_get_type ())
 #define SUSPEND(obj) \
@@ -43,7 +46,9 @@ struct _SuspendClass {
 
 GType           suspend_get_type            (void) G_GNUC_CONST;
 
-GObject*        suspend_new                 (gboolean simulate);
+GObject*        suspend_new                 (BatterySource *source,
+                                             Settings      *settings,
+                                             gboolean       simulate);
 
 G_END_DECLS
 
@@ -0,0 +1,492 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include "battery_source.h"
+#include "power_supply.h"
+#include "sysfs_source.h"
+
+// Some drivers only send uevents on status changes, poll while plugged
+#define SYSFS_SOURCE_REFRESH  30
+#define UEVENT_BUFFER_SIZE    8192
+#define UEVENT_SUBSYSTEM      "SUBSYSTEM=power_supply"
+// Message bytes searched for subsystem by socket filter
+#define UEVENT_FILTER_RANGE   512
+
+enum {
+    PROP_0,
+    PROP_BATTERY
+};
+
+typedef enum {
+    UEVENT_CAPACITY,
+    UEVENT_STATUS,
+    UEVENT_ENERGY_NOW,
+    UEVENT_ENERGY_FULL,
+    UEVENT_POWER_NOW,
+    UEVENT_CURRENT_NOW,
+    UEVENT_VOLTAGE_NOW,
+    UEVENT_LAST
+} UeventKey;
+
+static const gchar *UEVENT_KEYS[UEVENT_LAST] = {
+    "POWER_SUPPLY_CAPACITY=",
+    "POWER_SUPPLY_STATUS=",
+    "POWER_SUPPLY_ENERGY_NOW=",
+    "POWER_SUPPLY_ENERGY_FULL=",
+    "POWER_SUPPLY_POWER_NOW=",
+    "POWER_SUPPLY_CURRENT_NOW=",
+    "POWER_SUPPLY_VOLTAGE_NOW="
+};
+
+struct _SysfsSourcePrivate {
+    gchar *battery;
+    guint refresh_timeout_id;
+    gint online;
+
+    gint uevent_fd;
+    guint uevent_source_id;
+};
+
+static void sysfs_source_battery_source_init (BatterySourceInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    SysfsSource,
+    sysfs_source,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (SysfsSource)
+    G_IMPLEMENT_INTERFACE (
+        TYPE_BATTERY_SOURCE, sysfs_source_battery_source_init
+    )
+)
+
+static guint32
+get_state (const gchar *status) {
+    if (g_strcmp0 (status, "Charging") == 0)
+        return BATTERY_STATE_CHARGING;
+    if (g_strcmp0 (status, "Discharging") == 0)
+        return BATTERY_STATE_DISCHARGING;
+    if (g_strcmp0 (status, "Full") == 0)
+        return BATTERY_STATE_FULLY_CHARGED;
+    if (g_strcmp0 (status, "Not charging") == 0)
+        return BATTERY_STATE_PENDING_CHARGE;
+    return BATTERY_STATE_UNKNOWN;
+}
+
+/*
+ * Split uevent content in place, values point into content.
+ */
+static void
+parse_uevent (gchar        *content,
+              const gchar **values) {
+    gchar *line = content;
+
+    while (line != NULL && *line != '\0') {
+        gchar *next = strchr (line, '\n');
+        gint key;
+
+        if (next != NULL)
+            *next++ = '\0';
+
+        for (key = 0; key < UEVENT_LAST; key++) {
+            if (g_str_has_prefix (line, UEVENT_KEYS[key])) {
+                values[key] = line + strlen (UEVENT_KEYS[key]);
+                break;
+            }
+        }
+
+        line = next;
+    }
+}
+
+static void
+add_micro_value (GVariantBuilder *builder,
+                 const gchar     *key,
+                 const gchar     *value) {
+    if (value == NULL)
+        return;
+
+    // µWh and µW to Wh and W, as UPower does
+    g_variant_builder_add (
+        builder,
+        "{sv}",
+        key,
+        g_variant_new_double (ABS (g_ascii_strtod (value, NULL)) / 1000000)
+    );
+}
+
+static gboolean sysfs_source_refresh (SysfsSource *self);
+
+/*
+ * Unplugged, uevents are enough: no decision depends on battery level.
+ * Without uevents, keep polling to notice a plug.
+ */
+static void
+update_refresh_timeout (SysfsSource *self) {
+    if (self->priv->online == FALSE && self->priv->uevent_fd >= 0) {
+        g_clear_handle_id (&self->priv->refresh_timeout_id, g_source_remove);
+        return;
+    }
+
+    if (self->priv->refresh_timeout_id == 0)
+        self->priv->refresh_timeout_id = g_timeout_add_seconds (
+            SYSFS_SOURCE_REFRESH,
+            (GSourceFunc) sysfs_source_refresh,
+            self
+        );
+}
+
+static gboolean
+sysfs_source_refresh (SysfsSource *self) {
+    g_autofree gchar *uevent = NULL;
+    const gchar *values[UEVENT_LAST] = { NULL };
+    GVariantBuilder builder;
+    guint32 state;
+    gboolean online;
+
+    // All values in a single read, consistent with each other
+    uevent = power_supply_get_attribute (self->priv->battery, "uevent");
+    if (uevent == NULL) {
+        update_refresh_timeout (self);
+        return G_SOURCE_CONTINUE;
+    }
+
+    parse_uevent (uevent, values);
+    state = get_state (values[UEVENT_STATUS]);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    if (values[UEVENT_CAPACITY] != NULL)
+        g_variant_builder_add (
+            &builder,
+            "{sv}",
+            "Percentage",
+            g_variant_new_double (
+                g_ascii_strtod (values[UEVENT_CAPACITY], NULL)
+            )
+        );
+    add_micro_value (&builder, "Energy", values[UEVENT_ENERGY_NOW]);
+    add_micro_value (&builder, "EnergyFull", values[UEVENT_ENERGY_FULL]);
+    if (values[UEVENT_POWER_NOW] != NULL) {
+        add_micro_value (&builder, "EnergyRate", values[UEVENT_POWER_NOW]);
+    } else if (values[UEVENT_CURRENT_NOW] != NULL &&
+            values[UEVENT_VOLTAGE_NOW] != NULL) {
+        // µA by µV
+        g_variant_builder_add (
+            &builder,
+            "{sv}",
+            "EnergyRate",
+            g_variant_new_double (
+                ABS (g_ascii_strtod (values[UEVENT_CURRENT_NOW], NULL) *
+                     g_ascii_strtod (values[UEVENT_VOLTAGE_NOW], NULL)) /
+                1000000000000
+            )
+        );
+    }
+
+    battery_source_emit_sample (
+        BATTERY_SOURCE (self), g_variant_builder_end (&builder)
+    );
+
+    if ((power_supply_get_online (&online) ||
+            battery_source_state_to_online (state, &online)) &&
+            online != self->priv->online) {
+        self->priv->online = online;
+        battery_source_emit_online (BATTERY_SOURCE (self), online);
+    }
+
+    update_refresh_timeout (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+is_power_supply_uevent (const gchar *message,
+                        gssize       length) {
+    const gchar *field = message;
+
+    // "ACTION@DEVPATH\0KEY=VALUE\0..."
+    while (field < message + length) {
+        if (g_strcmp0 (field, UEVENT_SUBSYSTEM) == 0)
+            return TRUE;
+        field += strlen (field) + 1;
+    }
+    return FALSE;
+}
+
+static gboolean
+on_uevent (gint         fd,
+           GIOCondition condition,
+           gpointer     user_data) {
+    SysfsSource *self = SYSFS_SOURCE (user_data);
+    gchar buffer[UEVENT_BUFFER_SIZE];
+    gboolean changed = FALSE;
+    gssize length;
+
+    // Drain pending events, a charger plug sends a burst of them
+    while ((length = recv (fd, buffer, sizeof (buffer) - 1, 0)) > 0) {
+        buffer[length] = '\0';
+        if (is_power_supply_uevent (buffer, length))
+            changed = TRUE;
+    }
+
+    if (changed)
+        sysfs_source_refresh (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static guint32
+get_filter_word (const gchar *string,
+                 guint        size) {
+    guint32 word = 0;
+    guint i;
+
+    // Packet loads are big endian
+    for (i = 0; i < size; i++)
+        word = (word << 8) | (guint8) string[i];
+
+    return word;
+}
+
+static void
+add_filter (GArray  *filter,
+            guint16  code,
+            guint32  k,
+            guint8   jf) {
+    struct sock_filter instruction = { code, 0, jf, k };
+
+    g_array_append_val (filter, instruction);
+}
+
+/*
+ * Only wake up on power_supply uevents. Fields have no fixed offset:
+ * look for field start at each message offset, then check the whole
+ * field, with its NUL, from there. Loads past message end drop it.
+ */
+static void
+attach_uevent_filter (gint fd) {
+    g_autoptr(GArray) filter = g_array_new (
+        FALSE, FALSE, sizeof (struct sock_filter)
+    );
+    const gchar *field = UEVENT_SUBSYSTEM;
+    guint length = strlen (UEVENT_SUBSYSTEM) + 1;
+    struct sock_fprog program;
+    guint verify = UEVENT_FILTER_RANGE * 4 + 1;
+    guint offset;
+    guint size;
+    guint i;
+
+    for (offset = 0; offset < UEVENT_FILTER_RANGE; offset++) {
+        add_filter (filter, BPF_LD | BPF_W | BPF_ABS, offset, 0);
+        add_filter (
+            filter, BPF_JMP | BPF_JEQ | BPF_K, get_filter_word (field, 4), 2
+        );
+        add_filter (filter, BPF_LDX | BPF_IMM, offset, 0);
+        add_filter (filter, BPF_JMP | BPF_JA, verify - filter->len - 1, 0);
+    }
+    add_filter (filter, BPF_RET | BPF_K, 0, 0);
+
+    for (i = 4; i < length; i += size) {
+        size = length - i >= 4 ? 4 : length - i >= 2 ? 2 : 1;
+        add_filter (
+            filter,
+            BPF_LD | BPF_IND |
+                (size == 4 ? BPF_W : size == 2 ? BPF_H : BPF_B),
+            i,
+            0
+        );
+        add_filter (
+            filter,
+            BPF_JMP | BPF_JEQ | BPF_K,
+            get_filter_word (field + i, size),
+            0
+        );
+    }
+    add_filter (filter, BPF_RET | BPF_K, G_MAXUINT32, 0);
+    add_filter (filter, BPF_RET | BPF_K, 0, 0);
+
+    // Mismatches jump to last instruction
+    for (i = verify; i < filter->len - 2; i++) {
+        struct sock_filter *instruction = &g_array_index (
+            filter, struct sock_filter, i
+        );
+
+        if (BPF_CLASS (instruction->code) == BPF_JMP)
+            instruction->jf = filter->len - i - 2;
+    }
+
+    program.len = filter->len;
+    program.filter = (struct sock_filter *) filter->data;
+    if (setsockopt (fd,
+                    SOL_SOCKET,
+                    SO_ATTACH_FILTER,
+                    &program,
+                    sizeof (program)) != 0)
+        g_warning ("Can't filter uevents: %s", g_strerror (errno));
+}
+
+static void
+sysfs_source_listen (SysfsSource *self) {
+    struct sockaddr_nl address = { 0 };
+
+    self->priv->uevent_fd = socket (
+        AF_NETLINK,
+        SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+        NETLINK_KOBJECT_UEVENT
+    );
+    if (self->priv->uevent_fd < 0) {
+        g_warning ("Can't create uevent socket: %s", g_strerror (errno));
+        return;
+    }
+
+    // Kernel events multicast group
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1;
+    if (bind (self->priv->uevent_fd,
+              (struct sockaddr *) &address,
+              sizeof (address)) != 0) {
+        g_warning ("Can't listen to uevents: %s", g_strerror (errno));
+        close (self->priv->uevent_fd);
+        self->priv->uevent_fd = -1;
+        return;
+    }
+
+    attach_uevent_filter (self->priv->uevent_fd);
+
+    self->priv->uevent_source_id = g_unix_fd_add (
+        self->priv->uevent_fd, G_IO_IN, on_uevent, self
+    );
+}
+
+static void
+sysfs_source_start (BatterySource *source) {
+    SysfsSource *self = SYSFS_SOURCE (source);
+
+    if (self->priv->battery == NULL)
+        self->priv->battery = power_supply_get_battery ();
+
+    if (self->priv->battery == NULL) {
+        g_warning ("No battery found in %s", power_supply_get_root ());
+        return;
+    }
+
+    g_message ("Reading battery: %s", self->priv->battery);
+
+    sysfs_source_listen (self);
+    sysfs_source_refresh (self);
+}
+
+static void
+sysfs_source_battery_source_init (BatterySourceInterface *iface)
+{
+    iface->start = sysfs_source_start;
+}
+
+static void
+sysfs_source_set_property (GObject *object,
+                           guint property_id,
+                           const GValue *value,
+                           GParamSpec *pspec)
+{
+    SysfsSource *self = SYSFS_SOURCE (object);
+
+    switch (property_id) {
+        case PROP_BATTERY:
+            self->priv->battery = g_value_dup_string (value);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+sysfs_source_dispose (GObject *sysfs_source)
+{
+    SysfsSource *self = SYSFS_SOURCE (sysfs_source);
+
+    g_clear_handle_id (&self->priv->refresh_timeout_id, g_source_remove);
+    g_clear_handle_id (&self->priv->uevent_source_id, g_source_remove);
+    if (self->priv->uevent_fd >= 0) {
+        close (self->priv->uevent_fd);
+        self->priv->uevent_fd = -1;
+    }
+    g_clear_pointer (&self->priv->battery, g_free);
+
+    G_OBJECT_CLASS (sysfs_source_parent_class)->dispose (sysfs_source);
+}
+
+static void
+sysfs_source_finalize (GObject *sysfs_source)
+{
+    G_OBJECT_CLASS (sysfs_source_parent_class)->finalize (sysfs_source);
+}
+
+static void
+sysfs_source_class_init (SysfsSourceClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = sysfs_source_dispose;
+    object_class->finalize = sysfs_source_finalize;
+    object_class->set_property = sysfs_source_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_BATTERY,
+        g_param_spec_string (
+            "battery",
+            "Battery",
+            "Battery power supply name, first battery if NULL",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+}
+
+static void
+sysfs_source_init (SysfsSource *self)
+{
+    self->priv = sysfs_source_get_instance_private (self);
+
+    self->priv->battery = NULL;
+    self->priv->refresh_timeout_id = 0;
+    self->priv->online = -1;
+    self->priv->uevent_fd = -1;
+    self->priv->uevent_source_id = 0;
+}
+
+/**
+ * sysfs_source_new:
+ *
+ * Creates a new #SysfsSource, reading battery uevent on power_supply
+ * uevents and periodically
+ *
+ * @battery: (nullable): battery power supply name, first battery if NULL
+ *
+ * Returns: (transfer full): a new #SysfsSource
+ *
+ **/
+GObject *
+sysfs_source_new (const gchar *battery)
+{
+    GObject *sysfs_source;
+
+    sysfs_source = g_object_new (
+        TYPE_SYSFS_SOURCE, "battery", battery, NULL
+    );
+
+    return sysfs_source;
+}
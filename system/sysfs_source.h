@@ -0,0 +1,50 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef SYSFS_SOURCE_H
+#define SYSFS_SOURCE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_SYSFS_SOURCE \
+    (sysfs_source_get_type ())
+#define SYSFS_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_SYSFS_SOURCE, SysfsSource))
+#define SYSFS_SOURCE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_SYSFS_SOURCE, SysfsSourceClass))
+#define IS_SYSFS_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_SYSFS_SOURCE))
+#define IS_SYSFS_SOURCE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_SYSFS_SOURCE))
+#define SYSFS_SOURCE_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_SYSFS_SOURCE, SysfsSourceClass))
+
+G_BEGIN_DECLS
+
+typedef struct _SysfsSource SysfsSource;
+typedef struct _SysfsSourceClass SysfsSourceClass;
+typedef struct _SysfsSourcePrivate SysfsSourcePrivate;
+
+struct _SysfsSource {
+    GObject parent;
+    SysfsSourcePrivate *priv;
+};
+
+struct _SysfsSourceClass {
+    GObjectClass parent_class;
+};
+
+GType           sysfs_source_get_type (void) G_GNUC_CONST;
+
+GObject*        sysfs_source_new      (const gchar *battery);
+
+G_END_DECLS
+
+#endif
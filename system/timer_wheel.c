@@ -0,0 +1,294 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include "timer_wheel.h"
+
+// Keep the timer armed to be notified of clock changes
+#define TIMER_WHEEL_IDLE_TIME 86400
+
+enum
+{
+    CLOCK_CHANGED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+typedef struct {
+    guint id;
+    gint64 deadline;
+    GSourceFunc function;
+    gpointer data;
+} TimerWheelEntry;
+
+struct _TimerWheelPrivate {
+    gint timer_fd;
+    guint timer_source_id;
+
+    GList *entries;
+    guint last_id;
+};
+
+G_DEFINE_TYPE_WITH_CODE (
+    TimerWheel,
+    timer_wheel,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (TimerWheel)
+)
+
+static gint
+compare_entries (gconstpointer a,
+                 gconstpointer b) {
+    const TimerWheelEntry *entry_a = a;
+    const TimerWheelEntry *entry_b = b;
+
+    if (entry_a->deadline < entry_b->deadline)
+        return -1;
+    return entry_a->deadline > entry_b->deadline;
+}
+
+static void
+arm_timer (TimerWheel *self) {
+    struct itimerspec spec = { 0 };
+
+    if (self->priv->timer_fd < 0)
+        return;
+
+    if (self->priv->entries != NULL) {
+        TimerWheelEntry *entry = self->priv->entries->data;
+
+        spec.it_value.tv_sec = entry->deadline;
+    } else {
+        spec.it_value.tv_sec = g_get_real_time () / G_USEC_PER_SEC +
+            TIMER_WHEEL_IDLE_TIME;
+    }
+
+    /*
+     * Absolute wall clock deadlines: the kernel cancels the timer if
+     * the clock is set, so we can replan instead of firing late
+     */
+    if (timerfd_settime (
+            self->priv->timer_fd,
+            TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+            &spec,
+            NULL) != 0)
+        g_warning ("Can't arm timer: %s", g_strerror (errno));
+}
+
+static void
+dispatch_entries (TimerWheel *self) {
+    gint64 timestamp = g_get_real_time () / G_USEC_PER_SEC;
+
+    while (self->priv->entries != NULL) {
+        TimerWheelEntry *entry = self->priv->entries->data;
+
+        if (entry->deadline > timestamp)
+            break;
+
+        self->priv->entries = g_list_delete_link (
+            self->priv->entries, self->priv->entries
+        );
+        entry->function (entry->data);
+        g_free (entry);
+    }
+}
+
+static gboolean
+on_timer_fd (gint         fd,
+             GIOCondition condition,
+             gpointer     user_data) {
+    TimerWheel *self = TIMER_WHEEL (user_data);
+    guint64 expirations;
+
+    if (read (fd, &expirations, sizeof (expirations)) < 0 &&
+            errno == ECANCELED) {
+        g_message ("System clock changed");
+        g_signal_emit (self, signals[CLOCK_CHANGED], 0);
+    }
+
+    dispatch_entries (self);
+    arm_timer (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+timer_wheel_dispose (GObject *timer_wheel)
+{
+    TimerWheel *self = TIMER_WHEEL (timer_wheel);
+
+    g_clear_handle_id (&self->priv->timer_source_id, g_source_remove);
+
+    if (self->priv->timer_fd >= 0) {
+        close (self->priv->timer_fd);
+        self->priv->timer_fd = -1;
+    }
+
+    g_list_free_full (self->priv->entries, g_free);
+    self->priv->entries = NULL;
+
+    G_OBJECT_CLASS (timer_wheel_parent_class)->dispose (timer_wheel);
+}
+
+static void
+timer_wheel_finalize (GObject *timer_wheel)
+{
+    G_OBJECT_CLASS (timer_wheel_parent_class)->finalize (timer_wheel);
+}
+
+static void
+timer_wheel_class_init (TimerWheelClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = timer_wheel_dispose;
+    object_class->finalize = timer_wheel_finalize;
+
+    signals[CLOCK_CHANGED] = g_signal_new (
+        "clock-changed",
+        G_OBJECT_CLASS_TYPE (object_class),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL, NULL, NULL,
+        G_TYPE_NONE,
+        0
+    );
+}
+
+static void
+timer_wheel_init (TimerWheel *self)
+{
+    self->priv = timer_wheel_get_instance_private (self);
+
+    self->priv->entries = NULL;
+    self->priv->last_id = 0;
+    self->priv->timer_source_id = 0;
+
+    self->priv->timer_fd = timerfd_create (
+        CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC
+    );
+
+    if (self->priv->timer_fd < 0) {
+        g_warning ("Can't create timer: %s", g_strerror (errno));
+        return;
+    }
+
+    self->priv->timer_source_id = g_unix_fd_add (
+        self->priv->timer_fd, G_IO_IN, on_timer_fd, self
+    );
+    arm_timer (self);
+}
+
+/**
+ * timer_wheel_new:
+ *
+ * Creates a new #TimerWheel
+ *
+ * Returns: (transfer full): a new #TimerWheel
+ *
+ **/
+GObject *
+timer_wheel_new (void)
+{
+    GObject *timer_wheel;
+
+    timer_wheel = g_object_new (TYPE_TIMER_WHEEL, NULL);
+
+    return timer_wheel;
+}
+
+static TimerWheel *default_timer_wheel = NULL;
+/**
+ * timer_wheel_get_default:
+ *
+ * Gets the default #TimerWheel.
+ *
+ * Return value: (transfer full): the default #TimerWheel.
+ */
+TimerWheel *
+timer_wheel_get_default (void)
+{
+    if (!default_timer_wheel) {
+        default_timer_wheel = TIMER_WHEEL (timer_wheel_new ());
+    }
+    return g_object_ref (default_timer_wheel);
+}
+
+/**
+ * timer_wheel_add:
+ *
+ * Call function once at deadline. Return value of function is ignored.
+ *
+ * @deadline: UTC timestamp
+ * @function: function to call
+ * @data: data to pass to function
+ *
+ * Return value: timer id, never 0
+ */
+guint
+timer_wheel_add (gint64      deadline,
+                 GSourceFunc function,
+                 gpointer    data)
+{
+    TimerWheel *self = timer_wheel_get_default ();
+    TimerWheelEntry *entry = g_new0 (TimerWheelEntry, 1);
+
+    entry->id = ++self->priv->last_id;
+    entry->deadline = deadline;
+    entry->function = function;
+    entry->data = data;
+
+    self->priv->entries = g_list_insert_sorted (
+        self->priv->entries, entry, compare_entries
+    );
+
+    if (self->priv->entries->data == entry)
+        arm_timer (self);
+
+    g_object_unref (self);
+
+    return entry->id;
+}
+
+/**
+ * timer_wheel_remove:
+ *
+ * Remove a timer added with timer_wheel_add().
+ *
+ * @id: timer id
+ */
+void
+timer_wheel_remove (guint id)
+{
+    TimerWheel *self = timer_wheel_get_default ();
+    GList *link;
+
+    for (link = self->priv->entries; link != NULL; link = link->next) {
+        TimerWheelEntry *entry = link->data;
+
+        if (entry->id == id) {
+            gboolean first = link == self->priv->entries;
+
+            self->priv->entries = g_list_delete_link (
+                self->priv->entries, link
+            );
+            g_free (entry);
+
+            if (first)
+                arm_timer (self);
+            break;
+        }
+    }
+
+    g_object_unref (self);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_TIMER_WHEEL \
+    (timer_wheel_get_type ())
+#define TIMER_WHEEL(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_TIMER_WHEEL, TimerWheel))
+#define TIMER_WHEEL_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_TIMER_WHEEL, TimerWheelClass))
+#define IS_TIMER_WHEEL(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_TIMER_WHEEL))
+#define IS_TIMER_WHEEL_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_TIMER_WHEEL))
+#define TIMER_WHEEL_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_TIMER_WHEEL, TimerWheelClass))
+
+G_BEGIN_DECLS
+
+typedef struct _TimerWheel TimerWheel;
+typedef struct _TimerWheelClass TimerWheelClass;
+typedef struct _TimerWheelPrivate TimerWheelPrivate;
+
+struct _TimerWheel {
+    GObject parent;
+    TimerWheelPrivate *priv;
+};
+
+struct _TimerWheelClass {
+    GObjectClass parent_class;
+};
+
+GType           timer_wheel_get_type          (void) G_GNUC_CONST;
+
+TimerWheel     *timer_wheel_get_default       (void);
+GObject*        timer_wheel_new               (void);
+guint           timer_wheel_add               (gint64       deadline,
+                                               GSourceFunc  function,
+                                               gpointer     data);
+void            timer_wheel_remove            (guint        id);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <gio/gio.h>
+
+#include "battery_source.h"
+#include "trace_source.h"
+
+#define SIMULATE_REFRESH_RATE 10000
+#define SIMULATE_CYCLE_START  79
+
+enum {
+    PROP_0,
+    PROP_FILENAME
+};
+
+/*
+ * One trace line: "<seconds> <percentage> <state> [<energy rate>]",
+ * seconds are relative to trace start, state is a UPower state.
+ */
+typedef struct {
+    gdouble time;
+    gdouble percentage;
+    guint32 state;
+    gdouble energy_rate;
+} TraceSample;
+
+struct _TraceSourcePrivate {
+    gchar *filename;
+    GArray *samples;
+    guint index;
+    guint timeout_id;
+
+    gdouble percentage;
+    gboolean charging;
+};
+
+static void trace_source_battery_source_init (BatterySourceInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    TraceSource,
+    trace_source,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (TraceSource)
+    G_IMPLEMENT_INTERFACE (
+        TYPE_BATTERY_SOURCE, trace_source_battery_source_init
+    )
+)
+
+static void
+trace_source_load (TraceSource *self) {
+    g_autoptr (GError) error = NULL;
+    g_autofree gchar *content = NULL;
+    g_auto (GStrv) lines = NULL;
+    gint i;
+
+    if (!g_file_get_contents (self->priv->filename, &content, NULL, &error)) {
+        g_warning ("Can't load trace: %s", error->message);
+        return;
+    }
+
+    lines = g_strsplit (content, "\n", -1);
+    for (i = 0; lines[i] != NULL; i++) {
+        TraceSample sample;
+        gchar *start;
+        gchar *end;
+
+        g_strstrip (lines[i]);
+        if (lines[i][0] == '\0' || lines[i][0] == '#')
+            continue;
+
+        start = lines[i];
+        sample.time = g_ascii_strtod (start, &end);
+        if (end != start) {
+            start = end;
+            sample.percentage = g_ascii_strtod (start, &end);
+        }
+        if (end != start) {
+            start = end;
+            sample.state = (guint32) g_ascii_strtoull (start, &end, 10);
+        }
+        if (end == start) {
+            g_warning ("Invalid trace line: %s", lines[i]);
+            continue;
+        }
+
+        start = end;
+        sample.energy_rate = g_ascii_strtod (start, &end);
+        if (end == start)
+            sample.energy_rate = -1;
+
+        g_array_append_val (self->priv->samples, sample);
+    }
+
+    g_message ("Loaded %u trace samples", self->priv->samples->len);
+}
+
+static void
+emit_percentage (TraceSource *self,
+                 gdouble      percentage) {
+    GVariantBuilder builder;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (
+        &builder, "{sv}", "Percentage", g_variant_new_double (percentage)
+    );
+    battery_source_emit_sample (
+        BATTERY_SOURCE (self), g_variant_builder_end (&builder)
+    );
+}
+
+static gboolean
+simulate_charging_cycle (TraceSource *self) {
+    if (self->priv->charging)
+        self->priv->percentage += 1;
+    else
+        self->priv->percentage -= 1;
+
+    emit_percentage (self, self->priv->percentage);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+replay_sample (TraceSource *self) {
+    TraceSample *sample = &g_array_index (
+        self->priv->samples, TraceSample, self->priv->index
+    );
+    GVariantBuilder builder;
+    gboolean online;
+
+    self->priv->timeout_id = 0;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (
+        &builder,
+        "{sv}",
+        "Percentage",
+        g_variant_new_double (sample->percentage)
+    );
+    if (sample->energy_rate >= 0)
+        g_variant_builder_add (
+            &builder,
+            "{sv}",
+            "EnergyRate",
+            g_variant_new_double (sample->energy_rate)
+        );
+    battery_source_emit_sample (
+        BATTERY_SOURCE (self), g_variant_builder_end (&builder)
+    );
+
+    if (battery_source_state_to_online (sample->state, &online))
+        battery_source_emit_online (BATTERY_SOURCE (self), online);
+
+    self->priv->index += 1;
+    if (self->priv->index >= self->priv->samples->len) {
+        g_message ("Trace replay done");
+        return G_SOURCE_REMOVE;
+    }
+
+    self->priv->timeout_id = g_timeout_add (
+        MAX (sample[1].time - sample->time, 0) * 1000,
+        (GSourceFunc) replay_sample,
+        self
+    );
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+trace_source_start (BatterySource *source) {
+    TraceSource *self = TRACE_SOURCE (source);
+
+    if (self->priv->filename == NULL) {
+        g_message ("Simulating charge cycle");
+        battery_source_emit_online (source, TRUE);
+        emit_percentage (self, self->priv->percentage);
+        self->priv->timeout_id = g_timeout_add (
+            SIMULATE_REFRESH_RATE,
+            (GSourceFunc) simulate_charging_cycle,
+            self
+        );
+        return;
+    }
+
+    trace_source_load (self);
+    if (self->priv->samples->len > 0)
+        replay_sample (self);
+}
+
+static void
+trace_source_set_charging (BatterySource *source,
+                           gboolean       charging) {
+    TraceSource *self = TRACE_SOURCE (source);
+
+    self->priv->charging = charging;
+}
+
+static void
+trace_source_battery_source_init (BatterySourceInterface *iface)
+{
+    iface->start = trace_source_start;
+    iface->set_charging = trace_source_set_charging;
+}
+
+static void
+trace_source_set_property (GObject *object,
+                           guint property_id,
+                           const GValue *value,
+                           GParamSpec *pspec)
+{
+    TraceSource *self = TRACE_SOURCE (object);
+
+    switch (property_id) {
+        case PROP_FILENAME:
+            self->priv->filename = g_value_dup_string (value);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+trace_source_dispose (GObject *trace_source)
+{
+    TraceSource *self = TRACE_SOURCE (trace_source);
+
+    g_clear_handle_id (&self->priv->timeout_id, g_source_remove);
+    g_clear_pointer (&self->priv->samples, g_array_unref);
+    g_clear_pointer (&self->priv->filename, g_free);
+
+    G_OBJECT_CLASS (trace_source_parent_class)->dispose (trace_source);
+}
+
+static void
+trace_source_finalize (GObject *trace_source)
+{
+    G_OBJECT_CLASS (trace_source_parent_class)->finalize (trace_source);
+}
+
+static void
+trace_source_class_init (TraceSourceClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = trace_source_dispose;
+    object_class->finalize = trace_source_finalize;
+    object_class->set_property = trace_source_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_FILENAME,
+        g_param_spec_string (
+            "filename",
+            "Trace file",
+            "Trace file, simulate a charge cycle if NULL",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+}
+
+static void
+trace_source_init (TraceSource *self)
+{
+    self->priv = trace_source_get_instance_private (self);
+
+    self->priv->filename = NULL;
+    self->priv->samples = g_array_new (FALSE, FALSE, sizeof (TraceSample));
+    self->priv->index = 0;
+    self->priv->timeout_id = 0;
+    self->priv->percentage = SIMULATE_CYCLE_START;
+    self->priv->charging = TRUE;
+}
+
+/**
+ * trace_source_new:
+ *
+ * Creates a new #TraceSource, replaying a recorded trace
+ *
+ * @filename: (nullable): trace file, simulate a charge cycle if NULL
+ *
+ * Returns: (transfer full): a new #TraceSource
+ *
+ **/
+GObject *
+trace_source_new (const gchar *filename)
+{
+    GObject *trace_source;
+
+    trace_source = g_object_new (
+        TYPE_TRACE_SOURCE, "filename", filename, NULL
+    );
+
+    return trace_source;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef TRACE_SOURCE_H
+#define TRACE_SOURCE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_TRACE_SOURCE \
+    (trace_source_get_type ())
+#define TRACE_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_TRACE_SOURCE, TraceSource))
+#define TRACE_SOURCE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_TRACE_SOURCE, TraceSourceClass))
+#define IS_TRACE_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_TRACE_SOURCE))
+#define IS_TRACE_SOURCE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_TRACE_SOURCE))
+#define TRACE_SOURCE_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_TRACE_SOURCE, TraceSourceClass))
+
+G_BEGIN_DECLS
+
+typedef struct _TraceSource TraceSource;
+typedef struct _TraceSourceClass TraceSourceClass;
+typedef struct _TraceSourcePrivate TraceSourcePrivate;
+
+struct _TraceSource {
+    GObject parent;
+    TraceSourcePrivate *priv;
+};
+
+struct _TraceSourceClass {
+    GObjectClass parent_class;
+};
+
+GType           trace_source_get_type (void) G_GNUC_CONST;
+
+GObject*        trace_source_new      (const gchar *filename);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,430 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <gio/gio.h>
+
+#include "battery_source.h"
+#include "power_supply.h"
+#include "upower_source.h"
+
+#define UPOWER_DBUS_NAME       "org.freedesktop.UPower"
+#define UPOWER_DBUS_PATH       "/org/freedesktop/UPower/devices/DisplayDevice"
+#define UPOWER_BATTERY_PATH    "/org/freedesktop/UPower/devices/battery_%s"
+#define UPOWER_DBUS_INTERFACE  "org.freedesktop.UPower.Device"
+#define PROPERTIES_INTERFACE   "org.freedesktop.DBus.Properties"
+
+typedef enum {
+    UPOWER_PERCENTAGE,
+    UPOWER_TIME_TO_FULL,
+    UPOWER_STATE,
+    UPOWER_ENERGY,
+    UPOWER_ENERGY_FULL,
+    UPOWER_ENERGY_RATE,
+    UPOWER_LAST
+} UpowerProperty;
+
+// Only properties used by samples, others are ignored
+static const gchar *UPOWER_PROPERTIES[UPOWER_LAST] = {
+    "Percentage",
+    "TimeToFull",
+    "State",
+    "Energy",
+    "EnergyFull",
+    "EnergyRate"
+};
+
+static GQuark upower_quarks[UPOWER_LAST];
+
+enum {
+    PROP_0,
+    PROP_BATTERY
+};
+
+struct _UpowerSourcePrivate {
+    gchar *path;
+    GDBusConnection *connection;
+    guint watch_id;
+    guint signal_id;
+
+    GCancellable *cancellable;
+    GVariantBuilder *read_builder;
+    guint read_pending;
+};
+
+typedef struct {
+    UpowerSource *self;
+    GCancellable *cancellable;
+    gint property;
+} UpowerRead;
+
+static void upower_source_battery_source_init (BatterySourceInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    UpowerSource,
+    upower_source,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (UpowerSource)
+    G_IMPLEMENT_INTERFACE (
+        TYPE_BATTERY_SOURCE, upower_source_battery_source_init
+    )
+)
+
+static gint
+get_property (const gchar *name) {
+    GQuark quark = g_quark_try_string (name);
+    gint property;
+
+    if (quark == 0)
+        return -1;
+
+    for (property = 0; property < UPOWER_LAST; property++)
+        if (upower_quarks[property] == quark)
+            return property;
+
+    return -1;
+}
+
+static void
+handle_properties (UpowerSource *self,
+                   GVariant     *properties) {
+    GVariantBuilder builder;
+    GVariantIter iter;
+    const gchar *name;
+    GVariant *value;
+    gboolean has_sample = FALSE;
+    gboolean has_state = FALSE;
+    guint32 state = BATTERY_STATE_UNKNOWN;
+    gboolean online;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_iter_init (&iter, properties);
+    while (g_variant_iter_next (&iter, "{&sv}", &name, &value)) {
+        gint property = get_property (name);
+
+        if (property == UPOWER_STATE &&
+                g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32)) {
+            state = g_variant_get_uint32 (value);
+            has_state = TRUE;
+        }
+
+        if (property >= 0) {
+            g_variant_builder_add (&builder, "{sv}", name, value);
+            has_sample = TRUE;
+        }
+
+        g_variant_unref (value);
+    }
+
+    // All properties changed together are handled as a single sample
+    if (has_sample)
+        battery_source_emit_sample (
+            BATTERY_SOURCE (self), g_variant_builder_end (&builder)
+        );
+    else
+        g_variant_builder_clear (&builder);
+
+    if (!has_state)
+        return;
+
+    if (power_supply_get_online (&online) ||
+            battery_source_state_to_online (state, &online))
+        battery_source_emit_online (BATTERY_SOURCE (self), online);
+}
+
+static void
+on_properties_changed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data) {
+    UpowerSource *self = UPOWER_SOURCE (user_data);
+    g_autoptr(GVariant) changed_properties = NULL;
+
+    // (sa{sv}as), interface is already matched by arg0
+    changed_properties = g_variant_get_child_value (parameters, 1);
+    handle_properties (self, changed_properties);
+}
+
+static void
+on_property_read (GObject      *source_object,
+                  GAsyncResult *result,
+                  gpointer      user_data) {
+    UpowerRead *read = user_data;
+    UpowerSource *self = read->self;
+    g_autoptr (GError) error = NULL;
+    g_autoptr(GVariant) reply = NULL;
+    g_autoptr(GVariant) value = NULL;
+    g_autoptr(GVariant) sample = NULL;
+
+    reply = g_dbus_connection_call_finish (
+        G_DBUS_CONNECTION (source_object), result, &error
+    );
+
+    // UPower vanished or source disposed, self may be gone
+    if (g_cancellable_is_cancelled (read->cancellable)) {
+        g_object_unref (read->cancellable);
+        g_free (read);
+        return;
+    }
+
+    if (error != NULL) {
+        g_warning (
+            "Can't read %s: %s",
+            UPOWER_PROPERTIES[read->property],
+            error->message
+        );
+    } else {
+        g_variant_get (reply, "(v)", &value);
+        g_variant_builder_add (
+            self->priv->read_builder,
+            "{sv}",
+            UPOWER_PROPERTIES[read->property],
+            value
+        );
+    }
+
+    g_object_unref (read->cancellable);
+    g_free (read);
+
+    self->priv->read_pending -= 1;
+    if (self->priv->read_pending > 0)
+        return;
+
+    // Current values are sent as a single sample
+    sample = g_variant_ref_sink (
+        g_variant_builder_end (self->priv->read_builder)
+    );
+    g_clear_pointer (&self->priv->read_builder, g_variant_builder_unref);
+
+    handle_properties (self, sample);
+}
+
+static void
+upower_source_read (UpowerSource *self) {
+    gint i;
+
+    self->priv->read_builder = g_variant_builder_new (
+        G_VARIANT_TYPE ("a{sv}")
+    );
+    self->priv->read_pending = UPOWER_LAST;
+
+    for (i = 0; i < UPOWER_LAST; i++) {
+        UpowerRead *read = g_new0 (UpowerRead, 1);
+
+        read->self = self;
+        read->cancellable = g_object_ref (self->priv->cancellable);
+        read->property = i;
+
+        g_dbus_connection_call (
+            self->priv->connection,
+            UPOWER_DBUS_NAME,
+            self->priv->path,
+            PROPERTIES_INTERFACE,
+            "Get",
+            g_variant_new (
+                "(ss)", UPOWER_DBUS_INTERFACE, UPOWER_PROPERTIES[i]
+            ),
+            G_VARIANT_TYPE ("(v)"),
+            G_DBUS_CALL_FLAGS_NONE,
+            -1,
+            read->cancellable,
+            on_property_read,
+            read
+        );
+    }
+}
+
+static void
+upower_source_unbind (UpowerSource *self) {
+    if (self->priv->cancellable != NULL) {
+        g_cancellable_cancel (self->priv->cancellable);
+        g_clear_object (&self->priv->cancellable);
+    }
+    g_clear_pointer (&self->priv->read_builder, g_variant_builder_unref);
+    self->priv->read_pending = 0;
+
+    if (self->priv->signal_id != 0) {
+        g_dbus_connection_signal_unsubscribe (
+            self->priv->connection, self->priv->signal_id
+        );
+        self->priv->signal_id = 0;
+    }
+    g_clear_object (&self->priv->connection);
+}
+
+static void
+on_upower_appeared (GDBusConnection *connection,
+                    const gchar     *name,
+                    const gchar     *name_owner,
+                    gpointer         user_data) {
+    UpowerSource *self = UPOWER_SOURCE (user_data);
+
+    g_message ("UPower appeared: %s", self->priv->path);
+
+    // UPower restarted, start over
+    upower_source_unbind (self);
+
+    self->priv->connection = g_object_ref (connection);
+    self->priv->cancellable = g_cancellable_new ();
+
+    // Match rule on exact path and interface, no property cache
+    self->priv->signal_id = g_dbus_connection_signal_subscribe (
+        self->priv->connection,
+        UPOWER_DBUS_NAME,
+        PROPERTIES_INTERFACE,
+        "PropertiesChanged",
+        self->priv->path,
+        UPOWER_DBUS_INTERFACE,
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        on_properties_changed,
+        self,
+        NULL
+    );
+
+    upower_source_read (self);
+}
+
+static void
+on_upower_vanished (GDBusConnection *connection,
+                    const gchar     *name,
+                    gpointer         user_data) {
+    UpowerSource *self = UPOWER_SOURCE (user_data);
+
+    g_message ("Waiting for UPower");
+
+    upower_source_unbind (self);
+}
+
+static void
+upower_source_start (BatterySource *source) {
+    UpowerSource *self = UPOWER_SOURCE (source);
+
+    // Never block startup on UPower, bind when it shows up
+    self->priv->watch_id = g_bus_watch_name (
+        G_BUS_TYPE_SYSTEM,
+        UPOWER_DBUS_NAME,
+        G_BUS_NAME_WATCHER_FLAGS_AUTO_START,
+        on_upower_appeared,
+        on_upower_vanished,
+        self,
+        NULL
+    );
+}
+
+static void
+upower_source_battery_source_init (BatterySourceInterface *iface)
+{
+    iface->start = upower_source_start;
+}
+
+static void
+upower_source_set_property (GObject *object,
+                            guint property_id,
+                            const GValue *value,
+                            GParamSpec *pspec)
+{
+    UpowerSource *self = UPOWER_SOURCE (object);
+    const gchar *battery;
+
+    switch (property_id) {
+        case PROP_BATTERY:
+            battery = g_value_get_string (value);
+            g_free (self->priv->path);
+            // UPower names battery objects after power_supply entries
+            if (battery != NULL)
+                self->priv->path = g_strdup_printf (
+                    UPOWER_BATTERY_PATH, battery
+                );
+            else
+                self->priv->path = g_strdup (UPOWER_DBUS_PATH);
+            return;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+upower_source_dispose (GObject *upower_source)
+{
+    UpowerSource *self = UPOWER_SOURCE (upower_source);
+
+    g_clear_handle_id (&self->priv->watch_id, g_bus_unwatch_name);
+    upower_source_unbind (self);
+    g_clear_pointer (&self->priv->path, g_free);
+
+    G_OBJECT_CLASS (upower_source_parent_class)->dispose (upower_source);
+}
+
+static void
+upower_source_finalize (GObject *upower_source)
+{
+    G_OBJECT_CLASS (upower_source_parent_class)->finalize (upower_source);
+}
+
+static void
+upower_source_class_init (UpowerSourceClass *klass)
+{
+    GObjectClass *object_class;
+    gint i;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = upower_source_dispose;
+    object_class->finalize = upower_source_finalize;
+    object_class->set_property = upower_source_set_property;
+
+    g_object_class_install_property (
+        object_class,
+        PROP_BATTERY,
+        g_param_spec_string (
+            "battery",
+            "Battery",
+            "Battery power supply name, display device if NULL",
+            NULL,
+            G_PARAM_WRITABLE|
+            G_PARAM_CONSTRUCT_ONLY
+        )
+    );
+
+    for (i = 0; i < UPOWER_LAST; i++)
+        upower_quarks[i] = g_quark_from_static_string (UPOWER_PROPERTIES[i]);
+}
+
+static void
+upower_source_init (UpowerSource *self)
+{
+    self->priv = upower_source_get_instance_private (self);
+
+    self->priv->path = NULL;
+    self->priv->connection = NULL;
+    self->priv->watch_id = 0;
+    self->priv->signal_id = 0;
+    self->priv->cancellable = NULL;
+    self->priv->read_builder = NULL;
+    self->priv->read_pending = 0;
+}
+
+/**
+ * upower_source_new:
+ *
+ * Creates a new #UpowerSource, reading an UPower device
+ *
+ * @battery: (nullable): battery power supply name, display device if NULL
+ *
+ * Returns: (transfer full): a new #UpowerSource
+ *
+ **/
+GObject *
+upower_source_new (const gchar *battery)
+{
+    GObject *upower_source;
+
+    upower_source = g_object_new (
+        TYPE_UPOWER_SOURCE, "battery", battery, NULL
+    );
+
+    return upower_source;
+}
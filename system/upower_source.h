@@ -0,0 +1,50 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef UPOWER_SOURCE_H
+#define UPOWER_SOURCE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_UPOWER_SOURCE \
+    (upower_source_get_type ())
+#define UPOWER_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_UPOWER_SOURCE, UpowerSource))
+#define UPOWER_SOURCE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_UPOWER_SOURCE, UpowerSourceClass))
+#define IS_UPOWER_SOURCE(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_UPOWER_SOURCE))
+#define IS_UPOWER_SOURCE_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_UPOWER_SOURCE))
+#define UPOWER_SOURCE_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_UPOWER_SOURCE, UpowerSourceClass))
+
+G_BEGIN_DECLS
+
+typedef struct _UpowerSource UpowerSource;
+typedef struct _UpowerSourceClass UpowerSourceClass;
+typedef struct _UpowerSourcePrivate UpowerSourcePrivate;
+
+struct _UpowerSource {
+    GObject parent;
+    UpowerSourcePrivate *priv;
+};
+
+struct _UpowerSourceClass {
+    GObjectClass parent_class;
+};
+
+GType           upower_source_get_type (void) G_GNUC_CONST;
+
+GObject*        upower_source_new      (const gchar *battery);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <stdio.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <glib-unix.h>
+
+#include "wake_alarm.h"
+
+#define LOGIND_DBUS_NAME "org.freedesktop.login1"
+#define LOGIND_DBUS_PATH "/org/freedesktop/login1"
+#define LOGIND_DBUS_INTERFACE "org.freedesktop.login1.Manager"
+
+#define RTC_WAKEALARM "/sys/class/rtc/rtc0/wakealarm"
+
+enum
+{
+    PREPARE_FOR_SLEEP,
+    RESUMED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+struct _WakeAlarmPrivate {
+    GDBusConnection *connection;
+    guint signal_id;
+
+    gint inhibit_fd;
+    GCancellable *inhibit_cancellable;
+    gint timer_fd;
+    guint timer_source_id;
+    gchar *rtc_wakealarm;
+    gboolean rtc_armed;
+
+    gint64 deadline;
+};
+
+G_DEFINE_TYPE_WITH_CODE (
+    WakeAlarm,
+    wake_alarm,
+    G_TYPE_OBJECT,
+    G_ADD_PRIVATE (WakeAlarm)
+)
+
+static void
+on_inhibitor_taken (GObject      *source_object,
+                    GAsyncResult *res,
+                    gpointer      user_data) {
+    WakeAlarm *self;
+    g_autoptr (GError) error = NULL;
+    g_autoptr (GVariant) result = NULL;
+    g_autoptr (GUnixFDList) fd_list = NULL;
+    gint32 index;
+
+    result = g_dbus_connection_call_with_unix_fd_list_finish (
+        G_DBUS_CONNECTION (source_object), &fd_list, res, &error
+    );
+
+    // Disposed
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+    self = WAKE_ALARM (user_data);
+    g_clear_object (&self->priv->inhibit_cancellable);
+
+    if (error != NULL) {
+        g_warning ("Can't take sleep inhibitor: %s", error->message);
+        return;
+    }
+
+    g_variant_get (result, "(h)", &index);
+    self->priv->inhibit_fd = g_unix_fd_list_get (fd_list, index, &error);
+
+    if (error != NULL)
+        g_warning ("Can't get sleep inhibitor: %s", error->message);
+}
+
+/*
+ * Logind may be slow on resume, do not block main loop
+ */
+static void
+take_inhibitor (WakeAlarm *self) {
+    if (self->priv->inhibit_fd >= 0 || self->priv->inhibit_cancellable != NULL)
+        return;
+
+    self->priv->inhibit_cancellable = g_cancellable_new ();
+    g_dbus_connection_call_with_unix_fd_list (
+        self->priv->connection,
+        LOGIND_DBUS_NAME,
+        LOGIND_DBUS_PATH,
+        LOGIND_DBUS_INTERFACE,
+        "Inhibit",
+        g_variant_new (
+            "(ssss)",
+            "sleep",
+            "Battery Input Manager",
+            "Arm charge wake alarm",
+            "delay"
+        ),
+        G_VARIANT_TYPE ("(h)"),
+        G_DBUS_CALL_FLAGS_NONE,
+        -1,
+        NULL,
+        self->priv->inhibit_cancellable,
+        on_inhibitor_taken,
+        self
+    );
+}
+
+static void
+release_inhibitor (WakeAlarm *self) {
+    if (self->priv->inhibit_fd < 0)
+        return;
+
+    close (self->priv->inhibit_fd);
+    self->priv->inhibit_fd = -1;
+}
+
+static gboolean
+write_rtc_wakealarm (WakeAlarm *self,
+                     gint64     value) {
+    FILE *file = fopen (self->priv->rtc_wakealarm, "w");
+
+    if (file == NULL) {
+        g_warning ("Can't open %s", self->priv->rtc_wakealarm);
+        return FALSE;
+    }
+
+    fprintf (file, "%ld", (long) value);
+    fclose (file);
+
+    return TRUE;
+}
+
+static void
+arm_wake_alarm (WakeAlarm *self,
+                gint64     deadline) {
+    gint64 timestamp = g_get_real_time () / G_USEC_PER_SEC;
+
+    if (self->priv->timer_fd >= 0) {
+        struct itimerspec spec = { 0 };
+
+        // Boot time does not jump, arm relative to now
+        spec.it_value.tv_sec = MAX (deadline - timestamp, 1);
+
+        if (timerfd_settime (self->priv->timer_fd, 0, &spec, NULL) == 0) {
+            g_message ("Wake alarm in %lds", (long) spec.it_value.tv_sec);
+            return;
+        }
+        g_warning ("Can't arm wake alarm timer");
+    }
+
+    // RTC needs to be cleared before a new alarm is accepted
+    if (write_rtc_wakealarm (self, 0) &&
+            write_rtc_wakealarm (self, MAX (deadline, timestamp + 1))) {
+        g_message ("RTC wake alarm at %ld", (long) deadline);
+        self->priv->rtc_armed = TRUE;
+    }
+}
+
+static void
+disarm_wake_alarm (WakeAlarm *self) {
+    if (self->priv->timer_fd >= 0) {
+        struct itimerspec spec = { 0 };
+
+        timerfd_settime (self->priv->timer_fd, 0, &spec, NULL);
+    }
+
+    if (self->priv->rtc_armed) {
+        write_rtc_wakealarm (self, 0);
+        self->priv->rtc_armed = FALSE;
+    }
+}
+
+static gboolean
+on_timer_fd (gint         fd,
+             GIOCondition condition,
+             gpointer     user_data) {
+    guint64 expirations;
+
+    if (read (fd, &expirations, sizeof (expirations)) > 0)
+        g_message ("Wake alarm expired");
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+on_prepare_for_sleep (GDBusConnection *connection,
+                      const gchar     *sender_name,
+                      const gchar     *object_path,
+                      const gchar     *interface_name,
+                      const gchar     *signal_name,
+                      GVariant        *parameters,
+                      gpointer         user_data) {
+    WakeAlarm *self = WAKE_ALARM (user_data);
+    gboolean start;
+
+    g_variant_get (parameters, "(b)", &start);
+
+    if (start) {
+        self->priv->deadline = 0;
+        g_signal_emit (self, signals[PREPARE_FOR_SLEEP], 0);
+
+        if (self->priv->deadline != 0)
+            arm_wake_alarm (self, self->priv->deadline);
+
+        release_inhibitor (self);
+    } else {
+        disarm_wake_alarm (self);
+        take_inhibitor (self);
+
+        g_signal_emit (self, signals[RESUMED], 0);
+    }
+}
+
+static void
+wake_alarm_dispose (GObject *wake_alarm)
+{
+    WakeAlarm *self = WAKE_ALARM (wake_alarm);
+
+    if (self->priv->connection != NULL && self->priv->signal_id != 0)
+        g_dbus_connection_signal_unsubscribe (
+            self->priv->connection, self->priv->signal_id
+        );
+    self->priv->signal_id = 0;
+
+    if (self->priv->inhibit_cancellable != NULL)
+        g_cancellable_cancel (self->priv->inhibit_cancellable);
+    g_clear_object (&self->priv->inhibit_cancellable);
+    release_inhibitor (self);
+    g_clear_handle_id (&self->priv->timer_source_id, g_source_remove);
+
+    if (self->priv->timer_fd >= 0) {
+        close (self->priv->timer_fd);
+        self->priv->timer_fd = -1;
+    }
+
+    g_clear_pointer (&self->priv->rtc_wakealarm, g_free);
+    g_clear_object (&self->priv->connection);
+
+    G_OBJECT_CLASS (wake_alarm_parent_class)->dispose (wake_alarm);
+}
+
+static void
+wake_alarm_finalize (GObject *wake_alarm)
+{
+    G_OBJECT_CLASS (wake_alarm_parent_class)->finalize (wake_alarm);
+}
+
+static void
+wake_alarm_class_init (WakeAlarmClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    object_class->dispose = wake_alarm_dispose;
+    object_class->finalize = wake_alarm_finalize;
+
+    signals[PREPARE_FOR_SLEEP] = g_signal_new (
+        "prepare-for-sleep",
+        G_OBJECT_CLASS_TYPE (object_class),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL, NULL, NULL,
+        G_TYPE_NONE,
+        0
+    );
+
+    signals[RESUMED] = g_signal_new (
+        "resumed",
+        G_OBJECT_CLASS_TYPE (object_class),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL, NULL, NULL,
+        G_TYPE_NONE,
+        0
+    );
+}
+
+static void
+wake_alarm_init (WakeAlarm *self)
+{
+    self->priv = wake_alarm_get_instance_private (self);
+
+    self->priv->connection = NULL;
+    self->priv->signal_id = 0;
+    self->priv->inhibit_fd = -1;
+    self->priv->inhibit_cancellable = NULL;
+    self->priv->timer_fd = -1;
+    self->priv->timer_source_id = 0;
+    self->priv->rtc_wakealarm = NULL;
+    self->priv->rtc_armed = FALSE;
+    self->priv->deadline = 0;
+}
+
+/**
+ * wake_alarm_new:
+ *
+ * Creates a new #WakeAlarm
+ *
+ * Returns: (transfer full): a new #WakeAlarm
+ *
+ **/
+GObject *
+wake_alarm_new (void)
+{
+    GObject *wake_alarm;
+
+    wake_alarm = g_object_new (TYPE_WAKE_ALARM, NULL);
+
+    return wake_alarm;
+}
+
+static WakeAlarm *default_wake_alarm = NULL;
+/**
+ * wake_alarm_get_default:
+ *
+ * Gets the default #WakeAlarm.
+ *
+ * Return value: (transfer full): the default #WakeAlarm.
+ */
+WakeAlarm *
+wake_alarm_get_default (void)
+{
+    if (!default_wake_alarm) {
+        default_wake_alarm = WAKE_ALARM (wake_alarm_new ());
+    }
+    return g_object_ref (default_wake_alarm);
+}
+
+/**
+ * wake_alarm_connect:
+ *
+ * Listen to logind sleep events and setup wake alarm.
+ *
+ * @self: a #WakeAlarm
+ * @logind_address: (nullable): D-Bus address providing logind,
+ *                  system bus if NULL
+ * @rtc_wakealarm: (nullable): RTC wakealarm node, if NULL a boot time
+ *                 alarm timer is used with rtc0 as fallback
+ */
+void
+wake_alarm_connect (WakeAlarm   *self,
+                    const gchar *logind_address,
+                    const gchar *rtc_wakealarm)
+{
+    g_autoptr (GError) error = NULL;
+
+    g_return_if_fail (self->priv->connection == NULL);
+
+    if (logind_address != NULL)
+        self->priv->connection = g_dbus_connection_new_for_address_sync (
+            logind_address,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+            G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+            NULL,
+            NULL,
+            &error
+        );
+    else
+        self->priv->connection = g_bus_get_sync (
+            G_BUS_TYPE_SYSTEM, NULL, &error
+        );
+
+    if (error != NULL) {
+        g_warning ("Can't contact logind: %s", error->message);
+        return;
+    }
+
+    if (rtc_wakealarm != NULL) {
+        self->priv->rtc_wakealarm = g_strdup (rtc_wakealarm);
+    } else {
+        self->priv->rtc_wakealarm = g_strdup (RTC_WAKEALARM);
+        self->priv->timer_fd = timerfd_create (
+            CLOCK_BOOTTIME_ALARM, TFD_NONBLOCK | TFD_CLOEXEC
+        );
+    }
+
+    if (self->priv->timer_fd >= 0)
+        self->priv->timer_source_id = g_unix_fd_add (
+            self->priv->timer_fd, G_IO_IN, on_timer_fd, self
+        );
+    else
+        g_message ("Using RTC wake alarm: %s", self->priv->rtc_wakealarm);
+
+    self->priv->signal_id = g_dbus_connection_signal_subscribe (
+        self->priv->connection,
+        LOGIND_DBUS_NAME,
+        LOGIND_DBUS_INTERFACE,
+        "PrepareForSleep",
+        LOGIND_DBUS_PATH,
+        NULL,
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        on_prepare_for_sleep,
+        self,
+        NULL
+    );
+
+    take_inhibitor (self);
+}
+
+/**
+ * wake_alarm_request:
+ *
+ * Request a wake up before deadline, only valid while handling
+ * "prepare-for-sleep". Earliest request wins.
+ *
+ * @self: a #WakeAlarm
+ * @deadline: UTC timestamp, 0 for none
+ */
+void
+wake_alarm_request (WakeAlarm *self,
+                    gint64     deadline)
+{
+    if (deadline == 0)
+        return;
+
+    if (self->priv->deadline == 0 || deadline < self->priv->deadline)
+        self->priv->deadline = deadline;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#ifndef WAKE_ALARM_H
+#define WAKE_ALARM_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+#define TYPE_WAKE_ALARM \
+    (wake_alarm_get_type ())
+#define WAKE_ALARM(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST \
+    ((obj), TYPE_WAKE_ALARM, WakeAlarm))
+#define WAKE_ALARM_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_CAST \
+    ((cls), TYPE_WAKE_ALARM, WakeAlarmClass))
+#define IS_WAKE_ALARM(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE \
+    ((obj), TYPE_WAKE_ALARM))
+#define IS_WAKE_ALARM_CLASS(cls) \
+    (G_TYPE_CHECK_CLASS_TYPE \
+    ((cls), TYPE_WAKE_ALARM))
+#define WAKE_ALARM_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS \
+    ((obj), TYPE_WAKE_ALARM, WakeAlarmClass))
+
+G_BEGIN_DECLS
+
+typedef struct _WakeAlarm WakeAlarm;
+typedef struct _WakeAlarmClass WakeAlarmClass;
+typedef struct _WakeAlarmPrivate WakeAlarmPrivate;
+
+struct _WakeAlarm {
+    GObject parent;
+    WakeAlarmPrivate *priv;
+};
+
+struct _WakeAlarmClass {
+    GObjectClass parent_class;
+};
+
+GType           wake_alarm_get_type          (void) G_GNUC_CONST;
+
+WakeAlarm      *wake_alarm_get_default       (void);
+GObject*        wake_alarm_new               (void);
+void            wake_alarm_connect           (WakeAlarm   *self,
+                                              const gchar *logind_address,
+                                              const gchar *rtc_wakealarm);
+void            wake_alarm_request           (WakeAlarm   *self,
+                                              gint64       deadline);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <gio/gio.h>
+
+#include "d-bus.h"
+
+/*
+ * Tests do not own a bus name, statistics go nowhere
+ */
+
+BimBus *
+bim_bus_get_default (void)
+{
+    return NULL;
+}
+
+void
+bim_bus_set_statistic (BimBus      *self,
+                       const gchar *key,
+                       GVariant    *value)
+{
+    g_variant_unref (g_variant_ref_sink (value));
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "charge_curve.h"
+
+/*
+ * One sample per percentage, step seconds apart
+ */
+static gint64
+add_samples (ChargeCurve *charge_curve,
+             gint64       timestamp,
+             gint         from,
+             gint         to,
+             gint64       step) {
+    gint percentage;
+
+    for (percentage = from; percentage <= to; percentage++) {
+        charge_curve_add_sample (charge_curve, timestamp, percentage);
+        timestamp += step;
+    }
+
+    return timestamp - step;
+}
+
+static void
+test_unknown (void) {
+    g_autoptr (GObject) charge_curve = charge_curve_new (NULL);
+
+    // No charger type yet
+    g_assert_cmpint (
+        charge_curve_get_time_to (CHARGE_CURVE (charge_curve), 50, 60), ==, -1
+    );
+
+    charge_curve_set_type (CHARGE_CURVE (charge_curve), "USB");
+    g_assert_cmpint (
+        charge_curve_get_time_to (CHARGE_CURVE (charge_curve), 50, 60), ==, -1
+    );
+    g_assert_cmpint (
+        charge_curve_get_time_to (CHARGE_CURVE (charge_curve), 60, 50), ==, 0
+    );
+}
+
+static void
+test_partial_first_step (void) {
+    g_autoptr (GObject) charge_curve = charge_curve_new (NULL);
+    ChargeCurve *self = CHARGE_CURVE (charge_curve);
+
+    charge_curve_set_type (self, "USB");
+
+    // Plugged in the middle of step 50, time to 51 is not a full step
+    charge_curve_add_sample (self, 0, 50.5);
+    charge_curve_add_sample (self, 100, 51);
+    charge_curve_add_sample (self, 160, 52);
+
+    g_assert_cmpint (charge_curve_get_time_to (self, 50, 52), ==, -1);
+    g_assert_cmpint (charge_curve_get_time_to (self, 51, 52), ==, 60);
+}
+
+static void
+test_prefix_sums (void) {
+    g_autoptr (GObject) charge_curve = charge_curve_new (NULL);
+    ChargeCurve *self = CHARGE_CURVE (charge_curve);
+    gint64 timestamp;
+
+    charge_curve_set_type (self, "USB");
+
+    timestamp = add_samples (self, 0, 50, 60, 60);
+    g_assert_cmpint (charge_curve_get_time_to (self, 51, 60), ==, 9 * 60);
+    g_assert_cmpint (charge_curve_get_time_to (self, 55, 56), ==, 60);
+    // Half of current step is done
+    g_assert_cmpint (
+        charge_curve_get_time_to (self, 51.5, 60), ==, 9 * 60 - 30
+    );
+    // Step 60 is not known yet
+    g_assert_cmpint (charge_curve_get_time_to (self, 51, 61), ==, -1);
+
+    // A jump over several steps shares its duration
+    charge_curve_add_sample (self, timestamp + 100, 62);
+    g_assert_cmpint (charge_curve_get_time_to (self, 60, 62), ==, 100);
+    g_assert_cmpint (charge_curve_get_time_to (self, 60, 61), ==, 50);
+}
+
+static void
+test_smoothing (void) {
+    g_autoptr (GObject) charge_curve = charge_curve_new (NULL);
+    ChargeCurve *self = CHARGE_CURVE (charge_curve);
+
+    charge_curve_set_type (self, "USB");
+
+    add_samples (self, 0, 50, 52, 100);
+    g_assert_cmpint (charge_curve_get_time_to (self, 51, 52), ==, 100);
+
+    // Charge interrupted, then a faster charge of same step
+    charge_curve_reset (self);
+    add_samples (self, 1000, 50, 52, 20);
+    g_assert_cmpint (
+        charge_curve_get_time_to (self, 51, 52), ==, (100 * 3 + 20) / 4
+    );
+}
+
+static void
+test_types (void) {
+    g_autoptr (GObject) charge_curve = charge_curve_new (NULL);
+    ChargeCurve *self = CHARGE_CURVE (charge_curve);
+
+    charge_curve_set_type (self, "USB");
+    add_samples (self, 0, 50, 52, 100);
+
+    charge_curve_set_type (self, "USB_PD");
+    g_assert_cmpint (charge_curve_get_time_to (self, 51, 52), ==, -1);
+
+    charge_curve_set_type (self, "USB");
+    g_assert_cmpint (charge_curve_get_time_to (self, 51, 52), ==, 100);
+}
+
+static void
+test_persistence (void) {
+    g_autofree gchar *directory = g_dir_make_tmp ("bim-XXXXXX", NULL);
+    g_autofree gchar *filename = g_build_filename (
+        directory, "charge-curves.bin", NULL
+    );
+    GObject *charge_curve;
+
+    g_assert_nonnull (directory);
+
+    charge_curve = charge_curve_new (filename);
+    charge_curve_set_type (CHARGE_CURVE (charge_curve), "USB");
+    add_samples (CHARGE_CURVE (charge_curve), 0, 50, 60, 60);
+    charge_curve_save (CHARGE_CURVE (charge_curve));
+    g_object_unref (charge_curve);
+
+    charge_curve = charge_curve_new (filename);
+    charge_curve_set_type (CHARGE_CURVE (charge_curve), "USB");
+    g_assert_cmpint (
+        charge_curve_get_time_to (CHARGE_CURVE (charge_curve), 51, 60),
+        ==,
+        9 * 60
+    );
+    g_object_unref (charge_curve);
+
+    g_unlink (filename);
+    g_rmdir (directory);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/charge-curve/unknown", test_unknown);
+    g_test_add_func (
+        "/charge-curve/partial-first-step", test_partial_first_step
+    );
+    g_test_add_func ("/charge-curve/prefix-sums", test_prefix_sums);
+    g_test_add_func ("/charge-curve/smoothing", test_smoothing);
+    g_test_add_func ("/charge-curve/types", test_types);
+    g_test_add_func ("/charge-curve/persistence", test_persistence);
+
+    return g_test_run ();
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <gio/gio.h>
+
+#include "charge_model.h"
+
+#define RATE_EPSILON 1e-9
+
+static void
+test_unknown (void) {
+    g_autoptr (GObject) charge_model = charge_model_new ();
+    ChargeModel *self = CHARGE_MODEL (charge_model);
+
+    g_assert_cmpfloat (charge_model_get_rate (self), ==, 0);
+    g_assert_cmpint (charge_model_get_time_to (self, 50, 60), ==, -1);
+    g_assert_cmpint (charge_model_get_time_to (self, 60, 50), ==, 0);
+}
+
+static void
+test_rate_hints (void) {
+    g_autoptr (GObject) charge_model = charge_model_new ();
+    ChargeModel *self = CHARGE_MODEL (charge_model);
+
+    charge_model_add_rate (self, 0.01);
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.01, RATE_EPSILON
+    );
+    g_assert_cmpint (charge_model_get_time_to (self, 50, 60), ==, 1000);
+
+    // Exponentially weighted
+    charge_model_add_rate (self, 0.02);
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.3 * 0.02 + 0.7 * 0.01, RATE_EPSILON
+    );
+
+    // Not a charge rate
+    charge_model_add_rate (self, -0.01);
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.3 * 0.02 + 0.7 * 0.01, RATE_EPSILON
+    );
+}
+
+static void
+test_fit (void) {
+    g_autoptr (GObject) charge_model = charge_model_new ();
+    ChargeModel *self = CHARGE_MODEL (charge_model);
+    gint64 time_to;
+    gint i;
+
+    // More samples than the ring buffer holds
+    for (i = 0; i < 40; i++)
+        charge_model_add_sample (self, 1000 + i * 60, 20 + i * 60 * 0.02);
+
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.02, RATE_EPSILON
+    );
+
+    time_to = charge_model_get_time_to (self, 50, 60);
+    g_assert_cmpint (time_to, >=, 499);
+    g_assert_cmpint (time_to, <=, 500);
+}
+
+static void
+test_fit_outliers (void) {
+    g_autoptr (GObject) charge_model = charge_model_new ();
+    ChargeModel *self = CHARGE_MODEL (charge_model);
+    gint i;
+
+    // Only the last samples count once ring buffer is full
+    for (i = 0; i < 16; i++)
+        charge_model_add_sample (self, i * 60, 20 + i * 60 * 0.05);
+    for (i = 16; i < 48; i++)
+        charge_model_add_sample (self, i * 60, 68 + (i - 16) * 60 * 0.01);
+
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.01, RATE_EPSILON
+    );
+}
+
+static void
+test_reset (void) {
+    g_autoptr (GObject) charge_model = charge_model_new ();
+    ChargeModel *self = CHARGE_MODEL (charge_model);
+    gint i;
+
+    for (i = 0; i < 8; i++)
+        charge_model_add_sample (self, i * 60, 20 + i * 60 * 0.02);
+
+    // Learnt rate is kept until enough new samples
+    charge_model_reset (self);
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.02, RATE_EPSILON
+    );
+
+    // Discharging samples are not a charge rate
+    charge_model_add_sample (self, 10000, 50);
+    charge_model_add_sample (self, 10060, 49);
+    g_assert_cmpfloat_with_epsilon (
+        charge_model_get_rate (self), 0.02, RATE_EPSILON
+    );
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/charge-model/unknown", test_unknown);
+    g_test_add_func ("/charge-model/rate-hints", test_rate_hints);
+    g_test_add_func ("/charge-model/fit", test_fit);
+    g_test_add_func ("/charge-model/fit-outliers", test_fit_outliers);
+    g_test_add_func ("/charge-model/reset", test_reset);
+
+    return g_test_run ();
+}
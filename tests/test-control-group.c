@@ -0,0 +1,251 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "control_group.h"
+#include "control_node.h"
+
+#define APPLY_TIMEOUT 5
+
+typedef struct {
+    gchar *directory;
+    GMainLoop *loop;
+    gboolean done;
+    gboolean applied;
+} Fixture;
+
+/*
+ * Nodes are written at offset 0 without truncating, as sysfs does:
+ * values of a node must have the same length
+ */
+static gchar *
+add_node (Fixture     *fixture,
+          const gchar *name,
+          const gchar *value) {
+    gchar *path = g_build_filename (fixture->directory, name, NULL);
+
+    g_assert_true (g_file_set_contents (path, value, -1, NULL));
+
+    return path;
+}
+
+static gchar *
+read_node (const gchar *path) {
+    gchar *value = NULL;
+
+    g_assert_true (g_file_get_contents (path, &value, NULL, NULL));
+
+    return g_strstrip (value);
+}
+
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data) {
+    fixture->directory = g_dir_make_tmp ("bim-XXXXXX", NULL);
+    fixture->loop = g_main_loop_new (NULL, FALSE);
+    g_assert_nonnull (fixture->directory);
+}
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data) {
+    g_autoptr (GDir) dir = g_dir_open (fixture->directory, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        g_autofree gchar *path = g_build_filename (
+            fixture->directory, name, NULL
+        );
+
+        g_unlink (path);
+    }
+    g_rmdir (fixture->directory);
+
+    g_clear_pointer (&fixture->directory, g_free);
+    g_clear_pointer (&fixture->loop, g_main_loop_unref);
+}
+
+static void
+on_applied (ControlGroup *control_group,
+            gboolean      applied,
+            gpointer      user_data) {
+    Fixture *fixture = user_data;
+
+    fixture->done = TRUE;
+    fixture->applied = applied;
+    g_main_loop_quit (fixture->loop);
+}
+
+static gboolean
+on_timeout (gpointer user_data) {
+    g_assert_not_reached ();
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+apply (Fixture           *fixture,
+       ControlGroup      *control_group,
+       ControlGroupState  state,
+       const gchar       *fallback) {
+    guint timeout_id = g_timeout_add_seconds (APPLY_TIMEOUT, on_timeout, NULL);
+
+    fixture->done = FALSE;
+    control_group_apply (control_group, state, fallback, on_applied, fixture);
+    if (!fixture->done)
+        g_main_loop_run (fixture->loop);
+    g_source_remove (timeout_id);
+
+    return fixture->applied;
+}
+
+static void
+test_apply (Fixture       *fixture,
+            gconstpointer  user_data) {
+    g_autoptr (GObject) control_group = control_group_new ();
+    ControlGroup *self = CONTROL_GROUP (control_group);
+    g_autofree gchar *input = add_node (fixture, "input_suspend", "0\n");
+    g_autofree gchar *threshold = add_node (fixture, "end_threshold", "80\n");
+    g_autofree gchar *value = NULL;
+    ControlGroupState state;
+
+    control_group_add_node (self, input, "0", "1", NULL);
+    control_group_add_node (self, threshold, "80", NULL, NULL);
+
+    g_assert_true (control_group_read_state (self, "60", &state));
+    g_assert_cmpint (state, ==, CONTROL_GROUP_RESUME);
+
+    // End threshold nodes use fallback value
+    g_assert_true (apply (fixture, self, CONTROL_GROUP_SUSPEND, "60"));
+    value = read_node (input);
+    g_assert_cmpstr (value, ==, "1");
+    g_clear_pointer (&value, g_free);
+    value = read_node (threshold);
+    g_assert_cmpstr (value, ==, "60");
+
+    g_assert_true (control_group_read_state (self, "60", &state));
+    g_assert_cmpint (state, ==, CONTROL_GROUP_SUSPEND);
+
+    // Without discharge values, nodes stay suspended while discharging
+    g_assert_true (apply (fixture, self, CONTROL_GROUP_DISCHARGE, "60"));
+    g_clear_pointer (&value, g_free);
+    value = read_node (input);
+    g_assert_cmpstr (value, ==, "1");
+}
+
+static void
+test_rollback (Fixture       *fixture,
+               gconstpointer  user_data) {
+    g_autoptr (GObject) control_group = control_group_new ();
+    ControlGroup *self = CONTROL_GROUP (control_group);
+    g_autofree gchar *first = add_node (fixture, "first", "0\n");
+    g_autofree gchar *second = add_node (fixture, "second", "1\n");
+    g_autofree gchar *missing = g_build_filename (
+        fixture->directory, "missing", "node", NULL
+    );
+    g_autofree gchar *last = add_node (fixture, "last", "0\n");
+    g_autofree gchar *value = NULL;
+
+    control_group_add_node (self, first, "0", "1", NULL);
+    control_group_add_node (self, second, "1", "0", NULL);
+    control_group_add_node (self, missing, "0", "1", NULL);
+    control_group_add_node (self, last, "0", "1", NULL);
+
+    g_test_expect_message (NULL, G_LOG_LEVEL_WARNING, "Can't write *");
+    g_test_expect_message (
+        NULL, G_LOG_LEVEL_WARNING, "Control group write failed*"
+    );
+    g_assert_false (apply (fixture, self, CONTROL_GROUP_SUSPEND, NULL));
+    g_test_assert_expected_messages ();
+
+    // Written nodes are back to previous state, next ones untouched
+    value = read_node (first);
+    g_assert_cmpstr (value, ==, "0");
+    g_clear_pointer (&value, g_free);
+    value = read_node (second);
+    g_assert_cmpstr (value, ==, "1");
+    g_clear_pointer (&value, g_free);
+    value = read_node (last);
+    g_assert_cmpstr (value, ==, "0");
+}
+
+static void
+test_busy (Fixture       *fixture,
+           gconstpointer  user_data) {
+    g_autoptr (GObject) control_group = control_group_new ();
+    ControlGroup *self = CONTROL_GROUP (control_group);
+    g_autofree gchar *input = add_node (fixture, "input_suspend", "0\n");
+    Fixture rejected = { 0 };
+
+    rejected.loop = fixture->loop;
+    control_group_add_node (self, input, "0", "1", NULL);
+
+    // Second apply fails through its callback, first one goes on
+    fixture->done = FALSE;
+    control_group_apply (
+        self, CONTROL_GROUP_SUSPEND, NULL, on_applied, fixture
+    );
+    g_test_expect_message (NULL, G_LOG_LEVEL_WARNING, "*busy*");
+    control_group_apply (
+        self, CONTROL_GROUP_RESUME, NULL, on_applied, &rejected
+    );
+    g_test_assert_expected_messages ();
+
+    while (!fixture->done || !rejected.done)
+        g_main_context_iteration (NULL, TRUE);
+
+    g_assert_true (fixture->applied);
+    g_assert_false (rejected.applied);
+}
+
+static void
+test_difference (Fixture       *fixture,
+                 gconstpointer  user_data) {
+    g_autoptr (GObject) shared = control_group_new ();
+    g_autoptr (GObject) routed = control_group_new ();
+    g_autoptr (GObject) difference = NULL;
+    g_autofree gchar *usb = add_node (fixture, "usb", "0\n");
+    g_autofree gchar *dc = add_node (fixture, "dc", "0\n");
+
+    control_group_add_node (CONTROL_GROUP (shared), usb, "0", "1", NULL);
+    control_group_add_node (CONTROL_GROUP (shared), dc, "0", "1", NULL);
+    control_group_add_node (CONTROL_GROUP (routed), usb, "0", "1", NULL);
+
+    difference = control_group_new_difference (
+        CONTROL_GROUP (shared), CONTROL_GROUP (routed)
+    );
+    g_assert_cmpuint (
+        control_group_get_length (CONTROL_GROUP (difference)), ==, 1
+    );
+    g_assert_cmpstr (
+        control_group_get_path (CONTROL_GROUP (difference), 0), ==, dc
+    );
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add (
+        "/control-group/apply", Fixture, NULL,
+        fixture_setup, test_apply, fixture_teardown
+    );
+    g_test_add (
+        "/control-group/rollback", Fixture, NULL,
+        fixture_setup, test_rollback, fixture_teardown
+    );
+    g_test_add (
+        "/control-group/busy", Fixture, NULL,
+        fixture_setup, test_busy, fixture_teardown
+    );
+    g_test_add (
+        "/control-group/difference", Fixture, NULL,
+        fixture_setup, test_difference, fixture_teardown
+    );
+
+    return g_test_run ();
+}
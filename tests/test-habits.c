@@ -0,0 +1,139 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "habits.h"
+
+// Monday 2024-01-01 00:00, tests run with TZ=UTC
+#define MONDAY 1704067200
+#define HOUR   3600
+#define DAY    (24 * HOUR)
+#define WEEK   (7 * DAY)
+
+static void
+add_mondays (Habits *habits,
+             gint    hour,
+             gint    weeks) {
+    gint week;
+
+    for (week = 0; week < weeks; week++)
+        habits_add_unplug (habits, MONDAY + week * WEEK + hour * HOUR + 600);
+}
+
+static void
+test_empty (void) {
+    g_autoptr (GObject) habits = habits_new (NULL);
+
+    g_assert_cmpint (
+        habits_get_next_unplug (HABITS (habits), MONDAY), ==, 0
+    );
+}
+
+static void
+test_min_count (void) {
+    g_autoptr (GObject) habits = habits_new (NULL);
+    gint64 now = MONDAY + 3 * WEEK + 6 * HOUR;
+
+    add_mondays (HABITS (habits), 8, 2);
+    g_assert_cmpint (habits_get_next_unplug (HABITS (habits), now), ==, 0);
+
+    add_mondays (HABITS (habits), 8, 1);
+    g_assert_cmpint (
+        habits_get_next_unplug (HABITS (habits), now),
+        ==,
+        MONDAY + 3 * WEEK + 8 * HOUR
+    );
+}
+
+static void
+test_next_week (void) {
+    g_autoptr (GObject) habits = habits_new (NULL);
+
+    add_mondays (HABITS (habits), 8, 3);
+
+    // Today unplug time is over, same weekday next week
+    g_assert_cmpint (
+        habits_get_next_unplug (HABITS (habits), MONDAY + 3 * WEEK + 9 * HOUR),
+        ==,
+        MONDAY + 4 * WEEK + 8 * HOUR
+    );
+    // Other days have no habit
+    g_assert_cmpint (
+        habits_get_next_unplug (HABITS (habits), MONDAY + 3 * WEEK + 2 * DAY),
+        ==,
+        MONDAY + 4 * WEEK + 8 * HOUR
+    );
+}
+
+static void
+test_min_share (void) {
+    g_autoptr (GObject) habits = habits_new (NULL);
+    gint64 now = MONDAY + 3 * WEEK + 6 * HOUR;
+    gint hour;
+
+    // Most frequent hour is below 30% of Monday unplugs
+    add_mondays (HABITS (habits), 8, 3);
+    for (hour = 10; hour < 20; hour++)
+        add_mondays (HABITS (habits), hour, 1);
+
+    g_assert_cmpint (habits_get_next_unplug (HABITS (habits), now), ==, 0);
+}
+
+static void
+test_most_frequent (void) {
+    g_autoptr (GObject) habits = habits_new (NULL);
+
+    add_mondays (HABITS (habits), 8, 3);
+    add_mondays (HABITS (habits), 17, 4);
+
+    g_assert_cmpint (
+        habits_get_next_unplug (HABITS (habits), MONDAY + 4 * WEEK),
+        ==,
+        MONDAY + 4 * WEEK + 17 * HOUR
+    );
+}
+
+static void
+test_persistence (void) {
+    g_autofree gchar *directory = g_dir_make_tmp ("bim-XXXXXX", NULL);
+    g_autofree gchar *filename = g_build_filename (
+        directory, "habits.bin", NULL
+    );
+    GObject *habits;
+
+    g_assert_nonnull (directory);
+
+    habits = habits_new (filename);
+    add_mondays (HABITS (habits), 8, 3);
+    habits_save (HABITS (habits));
+    g_object_unref (habits);
+
+    habits = habits_new (filename);
+    g_assert_cmpint (
+        habits_get_next_unplug (HABITS (habits), MONDAY + 3 * WEEK),
+        ==,
+        MONDAY + 3 * WEEK + 8 * HOUR
+    );
+    g_object_unref (habits);
+
+    g_unlink (filename);
+    g_rmdir (directory);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/habits/empty", test_empty);
+    g_test_add_func ("/habits/min-count", test_min_count);
+    g_test_add_func ("/habits/next-week", test_next_week);
+    g_test_add_func ("/habits/min-share", test_min_share);
+    g_test_add_func ("/habits/most-frequent", test_most_frequent);
+    g_test_add_func ("/habits/persistence", test_persistence);
+
+    return g_test_run ();
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright Cedric Bellegarde <cedric.bellegarde@adishatz.org>
+ */
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "control_group.h"
+#include "power_supply.h"
+#include "settings.h"
+
+#define ROOT "@ROOT@"
+
+typedef struct {
+    gchar *directory;
+    gchar *root;
+} Fixture;
+
+static const gchar *SUPPLIES[][2] = {
+    { "battery", "Battery" },
+    { "usb", "USB" },
+    { "dc", "Mains" },
+    { "wireless", "Wireless" },
+    { NULL, NULL }
+};
+
+static const gchar *NODES[] = {
+    "input_suspend",
+    "charge_control_start_threshold",
+    "charge_control_end_threshold",
+    "charge_behaviour",
+    NULL
+};
+
+static void
+add_file (const gchar *directory,
+          const gchar *name,
+          const gchar *content) {
+    g_autofree gchar *path = g_build_filename (directory, name, NULL);
+
+    g_assert_true (g_file_set_contents (path, content, -1, NULL));
+}
+
+static void
+remove_tree (const gchar *path) {
+    g_autoptr (GDir) dir = g_dir_open (path, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        g_autofree gchar *child = g_build_filename (path, name, NULL);
+
+        if (g_file_test (child, G_FILE_TEST_IS_DIR))
+            remove_tree (child);
+        else
+            g_unlink (child);
+    }
+    g_rmdir (path);
+}
+
+/*
+ * Fake power_supply class directory, every supply has every node
+ */
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data) {
+    gint i, j;
+
+    fixture->directory = g_dir_make_tmp ("bim-XXXXXX", NULL);
+    g_assert_nonnull (fixture->directory);
+    fixture->root = g_build_filename (
+        fixture->directory, "power_supply", NULL
+    );
+
+    for (i = 0; SUPPLIES[i][0] != NULL; i++) {
+        g_autofree gchar *supply = g_build_filename (
+            fixture->root, SUPPLIES[i][0], NULL
+        );
+
+        g_assert_cmpint (g_mkdir_with_parents (supply, 0755), ==, 0);
+        add_file (supply, "type", SUPPLIES[i][1]);
+        for (j = 0; NODES[j] != NULL; j++)
+            add_file (supply, NODES[j], "0\n");
+    }
+
+    power_supply_set_root (fixture->root);
+}
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data) {
+    power_supply_set_root (NULL);
+    settings_set_devices (NULL);
+
+    remove_tree (fixture->directory);
+    g_clear_pointer (&fixture->directory, g_free);
+    g_clear_pointer (&fixture->root, g_free);
+}
+
+/*
+ * Write devices json, ROOT being replaced by fake power_supply
+ * directory, and load it
+ */
+static GObject *
+load_settings (Fixture     *fixture,
+               const gchar *devices,
+               const gchar *battery) {
+    g_auto (GStrv) parts = g_strsplit (devices, ROOT, -1);
+    g_autofree gchar *content = g_strjoinv (fixture->root, parts);
+    g_autofree gchar *filename = g_build_filename (
+        fixture->directory, "devices.json", NULL
+    );
+
+    g_assert_true (g_file_set_contents (filename, content, -1, NULL));
+    settings_set_devices (filename);
+
+    return settings_new (battery);
+}
+
+static void
+assert_route (Fixture     *fixture,
+              Settings    *settings,
+              const gchar *input,
+              const gchar *supply,
+              guint        length) {
+    ControlGroup *control_group = settings_get_input_control_group (
+        settings, input
+    );
+    g_autofree gchar *path = g_build_filename (
+        fixture->root, supply, "input_suspend", NULL
+    );
+
+    g_assert_nonnull (control_group);
+    g_assert_cmpuint (control_group_get_length (control_group), ==, length);
+    g_assert_cmpstr (control_group_get_path (control_group, 0), ==, path);
+}
+
+static const gchar *ROUTES_JSON =
+    "["
+    "  {"
+    "    \"path\": \"" ROOT "/battery/input_suspend\","
+    "    \"suspend\": 1, \"resume\": 0, \"priority\": 0"
+    "  },"
+    "  {"
+    "    \"group\": ["
+    "      {"
+    "        \"path\": \"" ROOT "/usb/input_suspend\","
+    "        \"suspend\": 1, \"resume\": 0"
+    "      },"
+    "      {"
+    "        \"path\": \"" ROOT "/dc/input_suspend\","
+    "        \"suspend\": 1, \"resume\": 0"
+    "      }"
+    "    ],"
+    "    \"priority\": 10"
+    "  },"
+    "  {"
+    "    \"path\": \"" ROOT "/wireless/input_suspend\","
+    "    \"suspend\": 1, \"resume\": 0, \"priority\": 5"
+    "  },"
+    "  {"
+    "    \"path\": \"" ROOT "/battery/input_suspend\","
+    "    \"input\": \"usb\", \"battery\": \"battery\","
+    "    \"suspend\": 1, \"resume\": 0, \"priority\": 3"
+    "  },"
+    "  {"
+    "    \"path\": \"" ROOT "/missing/input_suspend\","
+    "    \"suspend\": 1, \"resume\": 0, \"priority\": 999"
+    "  }"
+    "]";
+
+static void
+test_routes (Fixture       *fixture,
+             gconstpointer  user_data) {
+    g_autoptr (GObject) object = load_settings (
+        fixture, ROUTES_JSON, NULL
+    );
+    Settings *settings = SETTINGS (object);
+
+    g_assert_true (settings_has_control (settings));
+    g_assert_cmpint (
+        settings_get_control_mode (settings), ==, SETTINGS_CONTROL_MODE_INPUT
+    );
+    g_assert_cmpstr (settings_get_control_class (settings), ==, "input");
+    g_assert_true (settings_has_routes (settings));
+
+    // Best ranked entry wins, unavailable nodes are ignored
+    assert_route (fixture, settings, NULL, "usb", 2);
+    assert_route (fixture, settings, "unknown", "usb", 2);
+
+    // Each group node is routed alone to its charger
+    assert_route (fixture, settings, "usb", "usb", 1);
+    assert_route (fixture, settings, "dc", "dc", 1);
+    assert_route (fixture, settings, "wireless", "wireless", 1);
+}
+
+static void
+test_battery (Fixture       *fixture,
+              gconstpointer  user_data) {
+    g_autoptr (GObject) object = load_settings (
+        fixture, ROUTES_JSON, "battery"
+    );
+    Settings *settings = SETTINGS (object);
+
+    // Shared charger nodes can't be driven per battery
+    g_assert_true (settings_has_control (settings));
+    g_assert_cmpstr (settings_get_battery (settings), ==, "battery");
+    assert_route (fixture, settings, NULL, "battery", 1);
+    assert_route (fixture, settings, "usb", "battery", 1);
+    assert_route (fixture, settings, "wireless", "battery", 1);
+}
+
+static void
+test_rank (Fixture       *fixture,
+           gconstpointer  user_data) {
+    g_autoptr (GObject) object = load_settings (
+        fixture,
+        "["
+        "  {"
+        "    \"path\": \"" ROOT "/usb/input_suspend\","
+        "    \"suspend\": 1, \"resume\": 0, \"priority\": 999"
+        "  },"
+        "  {"
+        "    \"path\": \"" ROOT "/battery/input_suspend\","
+        "    \"class\": \"charge\","
+        "    \"suspend\": 1, \"resume\": 0, \"priority\": 0"
+        "  }"
+        "]",
+        NULL
+    );
+    Settings *settings = SETTINGS (object);
+
+    // Least disruptive class wins whatever the priority
+    g_assert_cmpstr (settings_get_control_class (settings), ==, "charge");
+    g_assert_false (settings_has_routes (settings));
+    assert_route (fixture, settings, "usb", "battery", 1);
+}
+
+static void
+test_thresholds (Fixture       *fixture,
+                 gconstpointer  user_data) {
+    g_autoptr (GObject) object = load_settings (
+        fixture,
+        "["
+        "  {"
+        "    \"mode\": \"thresholds\", \"class\": \"threshold\","
+        "    \"start_path\": \""
+        ROOT "/battery/charge_control_start_threshold\","
+        "    \"end_path\": \""
+        ROOT "/battery/charge_control_end_threshold\""
+        "  },"
+        "  {"
+        "    \"path\": \"" ROOT "/battery/charge_behaviour\","
+        "    \"class\": \"charge\","
+        "    \"suspend\": \"inhibit-charge\", \"resume\": \"auto\","
+        "    \"discharge\": \"force-discharge\""
+        "  }"
+        "]",
+        NULL
+    );
+    Settings *settings = SETTINGS (object);
+    g_autofree gchar *path = g_build_filename (
+        fixture->root, "battery", "charge_control_end_threshold", NULL
+    );
+    ControlGroup *discharge_group;
+
+    g_assert_true (settings_has_control (settings));
+    g_assert_cmpint (
+        settings_get_control_mode (settings),
+        ==,
+        SETTINGS_CONTROL_MODE_THRESHOLDS
+    );
+    g_assert_cmpstr (settings_get_control_class (settings), ==, "threshold");
+    g_assert_cmpstr (
+        settings_get_sysfs_end_threshold_path (settings), ==, path
+    );
+
+    // Not selected, but still able to drain battery
+    discharge_group = settings_get_discharge_group (settings);
+    g_assert_nonnull (discharge_group);
+    g_assert_true (control_group_can_discharge (discharge_group));
+}
+
+static void
+test_no_control (Fixture       *fixture,
+                 gconstpointer  user_data) {
+    g_autoptr (GObject) object = load_settings (
+        fixture,
+        "["
+        "  {"
+        "    \"path\": \"" ROOT "/missing/input_suspend\","
+        "    \"suspend\": 1, \"resume\": 0"
+        "  }"
+        "]",
+        NULL
+    );
+    Settings *settings = SETTINGS (object);
+
+    g_assert_false (settings_has_control (settings));
+    g_assert_null (settings_get_input_control_group (settings, NULL));
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add (
+        "/settings/routes", Fixture, NULL,
+        fixture_setup, test_routes, fixture_teardown
+    );
+    g_test_add (
+        "/settings/battery", Fixture, NULL,
+        fixture_setup, test_battery, fixture_teardown
+    );
+    g_test_add (
+        "/settings/rank", Fixture, NULL,
+        fixture_setup, test_rank, fixture_teardown
+    );
+    g_test_add (
+        "/settings/thresholds", Fixture, NULL,
+        fixture_setup, test_thresholds, fixture_teardown
+    );
+    g_test_add (
+        "/settings/no-control", Fixture, NULL,
+        fixture_setup, test_no_control, fixture_teardown
+    );
+
+    return g_test_run ();
+}
@@ -316,16 +316,15 @@ bim_bus_remove_alarm (BimBus      *self,
 }
 
 /**
- * bim_bus_set_value:
+ * bim_bus_set_settings:
  *
- * Gets the next pending alarm.
+ * Sets several settings in one call, daemon re-plans once.
  *
  * @self: a #BimBus
- * @key: a setting key
- * @value: a setting value
+ * @settings: (transfer floating): a{si} settings
  */
 void
-bim_bus_set_value (BimBus *self, const gchar *key, gint value) {
+bim_bus_set_settings (BimBus *self, GVariant *settings) {
     g_autoptr (GError) error = NULL;
     g_autoptr(GVariant) result = NULL;
 
@@ -333,8 +332,8 @@ bim_bus_set_value (BimBus *self, const gchar *key, gint value) {
 
     result = g_dbus_proxy_call_sync (
         self->priv->bim_proxy,
-        "Set",
-        g_variant_new ("(&si)", key, value),
+        "SetSettings",
+        g_variant_new ("(@a{si})", settings),
         G_DBUS_CALL_FLAGS_NONE,
         -1,
         NULL,
@@ -342,7 +341,7 @@ bim_bus_set_value (BimBus *self, const gchar *key, gint value) {
     );
 
     if (error != NULL)
-        g_warning ("Error updating setting: %s", error->message);
+        g_warning ("Error updating settings: %s", error->message);
 }
 
 static BimBus *default_bim_bus = NULL;
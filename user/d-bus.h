@@ -51,9 +51,8 @@ void        bim_bus_add_alarm      (BimBus      *self,
                                     gint64       time);
 void        bim_bus_remove_alarm   (BimBus      *self,
                                     const gchar *alarm_id);
-void        bim_bus_set_value      (BimBus      *self,
-                                    const gchar *key,
-                                    gint         value);
+void        bim_bus_set_settings   (BimBus      *self,
+                                    GVariant    *settings);
 
 G_END_DECLS
 
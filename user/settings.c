@@ -20,16 +20,91 @@ G_DEFINE_TYPE_WITH_CODE (
     G_ADD_PRIVATE (Settings)
 )
 
+static const gchar *VALUE_KEYS[] = {
+    "hysteresis",
+    "dwell-time",
+    "toggles-per-hour",
+    NULL
+};
+
+static const gchar *THRESHOLD_KEYS[] = {
+    "threshold-max",
+    "threshold-start",
+    "threshold-end",
+    NULL
+};
+
 static void
-on_threshold_changed (GSettings   *settings,
-                      const gchar *key,
-                      gpointer     user_data) {
-    BimBus *bim_bus = bim_bus_get_default ();
-    gint value = g_settings_get_int (settings, key);
+add_value (Settings        *self,
+           GVariantBuilder *builder,
+           const gchar     *key) {
+    gint value = g_settings_get_int (self->priv->settings, key);
 
     g_message ("Setting changed: %s -> %d", key, value);
 
-    bim_bus_set_value (bim_bus, key, value);
+    g_variant_builder_add (builder, "{si}", key, value);
+}
+
+/*
+ * Changed settings are sent in one call, so daemon never plans with
+ * half updated settings. Thresholds are validated as a whole.
+ */
+static void
+send_settings (Settings     *self,
+               const gchar **keys,
+               gboolean      thresholds) {
+    GVariantBuilder builder;
+    gint i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{si}"));
+
+    for (i = 0; keys[i] != NULL; i++)
+        add_value (self, &builder, keys[i]);
+
+    if (thresholds)
+        for (i = 0; THRESHOLD_KEYS[i] != NULL; i++)
+            add_value (self, &builder, THRESHOLD_KEYS[i]);
+
+    bim_bus_set_settings (
+        bim_bus_get_default (), g_variant_builder_end (&builder)
+    );
+}
+
+static gboolean
+on_change_event (GSettings *settings,
+                 GQuark    *keys,
+                 gint       n_keys,
+                 gpointer   user_data) {
+    Settings *self = SETTINGS (user_data);
+    g_autoptr (GPtrArray) values = NULL;
+    gboolean thresholds = FALSE;
+    gint i;
+
+    if (!g_settings_get_boolean (self->priv->settings, "enabled"))
+        return FALSE;
+
+    // Unknown changes, send everything
+    if (keys == NULL) {
+        send_settings (self, VALUE_KEYS, TRUE);
+        return FALSE;
+    }
+
+    // A delayed apply or a dconf transaction comes as one event
+    values = g_ptr_array_new ();
+    for (i = 0; i < n_keys; i++) {
+        const gchar *key = g_quark_to_string (keys[i]);
+
+        if (g_strv_contains (THRESHOLD_KEYS, key))
+            thresholds = TRUE;
+        else if (g_strv_contains (VALUE_KEYS, key))
+            g_ptr_array_add (values, (gpointer) key);
+    }
+    g_ptr_array_add (values, NULL);
+
+    if (thresholds || values->len > 1)
+        send_settings (self, (const gchar **) values->pdata, thresholds);
+
+    return FALSE;
 }
 
 static void
@@ -47,23 +122,7 @@ on_enabled_changed (GSettings   *settings,
         return;
     }
 
-    on_threshold_changed (
-        self->priv->settings,
-        "threshold-max",
-        self
-    );
-
-    on_threshold_changed (
-        self->priv->settings,
-        "threshold-start",
-        self
-    );
-
-    on_threshold_changed (
-        self->priv->settings,
-        "threshold-end",
-        self
-    );
+    send_settings (self, VALUE_KEYS, TRUE);
 }
 
 static void
@@ -117,22 +176,8 @@ settings_init (Settings *self)
 
     g_signal_connect (
         self->priv->settings,
-        "changed::threshold-max",
-        G_CALLBACK (on_threshold_changed),
-        self
-    );
-
-    g_signal_connect (
-        self->priv->settings,
-        "changed::threshold-start",
-        G_CALLBACK (on_threshold_changed),
-        self
-    );
-
-    g_signal_connect (
-        self->priv->settings,
-        "changed::threshold-end",
-        G_CALLBACK (on_threshold_changed),
+        "change-event",
+        G_CALLBACK (on_change_event),
         self
     );
 }